@@ -0,0 +1,135 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "entity.hpp"
+
+// components opt into archetype storage by specializing this (see components.hpp)
+template<typename T>
+struct archetypal : std::false_type {};
+
+// archetype storage: entities with the same set of archetypal components share
+// fixed-size chunks, where each component type is one packed column
+//     (a chunk holds [entities][column 0][column 1]..., columns 16-byte aligned)
+class Archetypes {
+public:
+    static constexpr size_t maxColumns = 32;
+    static constexpr size_t chunkBytes = 16*1024;
+    static constexpr size_t npos = std::numeric_limits<size_t>::max();
+    using mask_t = uint32_t;
+    // column id of an archetypal component type
+    template<typename T>
+    static size_t column() {
+        static_assert(std::is_trivially_copyable<T>::value, "archetypal components are moved with memcpy\n");
+        static_assert(alignof(T) <= 16, "archetypal components must fit 16-byte aligned columns\n");
+        static const size_t id = registerColumn(sizeof(T));
+        return id;
+    }
+private:
+    struct alignas(64) Chunk {
+        unsigned char data[chunkBytes];
+    };
+    struct Archetype {
+        mask_t mask{ 0 };
+        // rows per chunk, total rows (all chunks are full except the last)
+        size_t capacity{ 0 };
+        size_t size{ 0 };
+        // byte offset of each column within a chunk
+        std::array<size_t,maxColumns> offsets{};
+        std::vector<std::unique_ptr<Chunk>> chunks;
+        // cached transitions: column -> archetype with that column toggled
+        std::unordered_map<size_t,size_t> edges;
+        entity* entities(size_t k) {
+            return reinterpret_cast<entity*>(chunks[k]->data);
+        }
+        unsigned char* at(size_t row, size_t col, size_t size) {
+            return chunks[row/capacity]->data + offsets[col] + (row%capacity)*size;
+        }
+    };
+    struct Record {
+        entity owner{ nullEntity };
+        size_t archetype{ npos };
+        size_t row{ 0 };
+    };
+    // archetypes are never destroyed, so indices stay valid
+    std::vector<Archetype> archetypes;
+    std::unordered_map<mask_t,size_t> byMask;
+    // entity index -> location
+    std::vector<Record> records;
+
+    static std::array<size_t,maxColumns>& columnSizes();
+    static size_t registerColumn(size_t size);
+    // find (or create) archetype by mask
+    size_t find(mask_t mask);
+    // archetype of entity (npos: not in archetype storage, or a stale handle)
+    size_t locate(entity e) const {
+        uint32_t i = entityIndex(e);
+        return (i < records.size() && records[i].owner == e) ? records[i].archetype : npos;
+    }
+    // archetype reached from a by adding / removing column col
+    size_t toggle(size_t a, size_t col);
+    // move entity into archetype a (npos: out of archetype storage), returns new row
+    size_t move(entity e, size_t a);
+    // swap-remove row from archetype a
+    void erase(size_t a, size_t row);
+    template<typename T>
+    static mask_t bit() { return mask_t(1) << column<T>(); }
+public:
+    template<typename T>
+    bool has(entity e) const {
+        size_t a = locate(e);
+        return a != npos && (archetypes[a].mask & bit<T>());
+    }
+    // construct component in place (overwrites an existing one)
+    template<typename T, typename ... Args>
+    T& emplace(entity e, Args&& ... args) {
+        if(!has<T>(e)) {
+            size_t from = locate(e);
+            size_t to = (from == npos) ? find(bit<T>()) : toggle(from, column<T>());
+            move(e, to);
+        }
+        Record r = records[entityIndex(e)];
+        void* slot = archetypes[r.archetype].at(r.row, column<T>(), sizeof(T));
+        return *new(slot) T(std::forward<Args>(args)...);
+    }
+    // get component of entity, nullptr if it has none
+    template<typename T>
+    T* get(entity e) {
+        if(!has<T>(e)) return nullptr;
+        Record r = records[entityIndex(e)];
+        return reinterpret_cast<T*>(archetypes[r.archetype].at(r.row, column<T>(), sizeof(T)));
+    }
+    template<typename T>
+    void remove(entity e) {
+        if(!has<T>(e)) return;
+        size_t from = locate(e);
+        move(e, (archetypes[from].mask == bit<T>()) ? npos : toggle(from, column<T>()));
+    }
+    // remove all archetypal components of entity
+    void clear(entity e) {
+        if(locate(e) != npos) move(e, npos);
+    }
+    // f(size_t n, entity* es, Ts*... cols) for every chunk whose archetype has all Ts
+    template<typename ... Ts, typename F>
+    void eachChunk(F&& f) {
+        const mask_t need = (bit<Ts>() | ...);
+        for(Archetype& a : archetypes) {
+            if((a.mask & need) != need) continue;
+            for(size_t k = 0; k < a.chunks.size(); ++k) {
+                size_t n = std::min(a.capacity, a.size - k*a.capacity);
+                unsigned char* data = a.chunks[k]->data;
+                f(n, a.entities(k), reinterpret_cast<Ts*>(data + a.offsets[column<Ts>()])...);
+            }
+        }
+    }
+};
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// packs images into a few fixed size atlas pages (skyline, bottom-left):
+//     each page keeps the top edge of what is placed as a list of segments, and
+//     a rect goes where its top ends lowest (then leftmost); rects are placed
+//     tallest first, in the first page they fit, opening pages as needed
+//     a rect larger than a page gets a page of its own size
+class AtlasPacker {
+public:
+    struct Placement {
+        size_t page;
+        int x, y;
+    };
+private:
+    struct Segment {
+        int x, y, w;
+    };
+    struct Page {
+        int w, h;
+        std::vector<Segment> skyline;
+    };
+    int pageW, pageH;
+    // gap kept around each rect (against sampling its neighbours)
+    int padding;
+    std::vector<Page> pages;
+    // place a w x h rect in p, false if it does not fit
+    static bool place(Page& p, int w, int h, int& x, int& y);
+public:
+    AtlasPacker(int pageW, int pageH, int padding = 1);
+    // placements of the rects (w, h), in the given order
+    std::vector<Placement> pack(const std::vector<std::pair<int,int>>& sizes);
+    // sizes of the pages made so far
+    std::vector<std::pair<int,int>> pageSizes() const;
+};
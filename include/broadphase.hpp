@@ -0,0 +1,49 @@
+#pragma once
+#include "utility.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// incremental sort and sweep on x: boxes persist between ticks (by id, e.g. an
+// entity index) and their order by left edge is kept, so re-sorting after a
+// tick's motion is an insertion sort over nearly sorted data
+class SweepAndPrune {
+    struct Box {
+        rectf r{ 0.f, 0.f, 0.f, 0.f };
+        bool dynamic{ false };
+        // inserted this tick / held in order
+        bool present{ false };
+        bool listed{ false };
+    };
+    std::vector<Box> boxes;
+    // ids by left edge (boxes inserted since the last sort are appended)
+    std::vector<uint32_t> order;
+    size_t sorted{ 0 };
+    // widest box as of the last sort (bounds how far left a range query looks)
+    float widest{ 0.f };
+    bool less(uint32_t a, uint32_t b) const { return boxes[a].r.x < boxes[b].r.x; }
+public:
+    // start a tick: boxes not inserted again before candidates() are dropped
+    void clear();
+    // set box id for this tick
+    void insert(uint32_t id, const rectf& r, bool dynamic);
+    // pairs (i < j) of ids whose boxes overlap and are not both static,
+    // each reported once, in ascending order
+    void candidates(std::vector<std::pair<uint32_t,uint32_t>>& out);
+    // box of id (as last inserted)
+    const rectf& box(uint32_t id) const { return boxes[id].r; }
+    // f(id) for boxes overlapping (or touching) r, as of the last candidates()
+    template<typename F>
+    void query(const rectf& r, F&& f) const {
+        // first box that could reach r: left edge at or right of r.x - widest
+        auto it = std::lower_bound(order.begin(), order.begin() + sorted, r.x - widest,
+            [this](uint32_t id, float x) { return boxes[id].r.x < x; });
+        for(; it != order.begin() + sorted && boxes[*it].r.x <= r.x + r.w; ++it) {
+            const rectf& b = boxes[*it].r;
+            if(b.x + b.w >= r.x && b.y <= r.y + r.h && b.y + b.h >= r.y) f(*it);
+        }
+    }
+};
@@ -1,8 +1,101 @@
 #pragma once
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "entity.hpp"
+#include "context.hpp"
 
 template<typename T>
 class Command {
 public:
     virtual ~Command() {}
-    virtual void execute(T& t);
-};
\ No newline at end of file
+    virtual void execute(T& t) = 0;
+};
+
+// entities created through a command buffer get a pending handle until the
+// buffer is applied (generation UINT32_MAX, index = order of creation)
+inline bool isPending(entity e) { return entityGeneration(e) == UINT32_MAX; }
+inline entity resolvePending(const std::vector<entity>& spawned, entity e) {
+    return isPending(e) ? spawned.at(entityIndex(e)) : e;
+}
+
+// batch of component changes of one type: pending handles are resolved against
+// the entities spawned by the buffer being applied (passed in, not kept, so a
+// batch holds no reference into its buffer)
+class ComponentBatch {
+public:
+    virtual ~ComponentBatch() {}
+    virtual void execute(Context& c, const std::vector<entity>& spawned) = 0;
+};
+// batch of component adds of one type
+template<typename T>
+class AddComponents : public ComponentBatch {
+    std::vector<std::pair<entity,T>> adds;
+public:
+    void push(entity e, T t) { adds.emplace_back(e, std::move(t)); }
+    void execute(Context& c, const std::vector<entity>& spawned) override {
+        c.reserve<T>(adds.size());
+        for(auto& [e, t] : adds) {
+            c.addComponent<T>(resolvePending(spawned, e), t);
+        }
+        adds.clear();
+    }
+};
+// batch of component removes of one type
+template<typename T>
+class RemoveComponents : public ComponentBatch {
+    std::vector<entity> removes;
+public:
+    void push(entity e) { removes.push_back(e); }
+    void execute(Context& c, const std::vector<entity>& spawned) override {
+        for(entity e : removes) {
+            c.removeComponent<T>(resolvePending(spawned, e));
+        }
+        removes.clear();
+    }
+};
+
+// records structural changes while systems run, applies them at a sync point:
+//     creations first, then component adds, then component removes, then
+//     destructions (so destroying an entity always wins)
+class CommandBuffer {
+    uint32_t pendingCount{ 0 };
+    std::vector<entity> spawned;
+    std::vector<entity> destroys;
+    // one batch per component type, in order of first use
+    std::vector<std::unique_ptr<ComponentBatch>> addBatches, removeBatches;
+    std::unordered_map<size_t,ComponentBatch*> addsByType, removesByType;
+    template<typename B, typename T>
+    B& batch(std::vector<std::unique_ptr<ComponentBatch>>& batches,
+             std::unordered_map<size_t,ComponentBatch*>& byType) {
+        ComponentBatch*& b = byType[componentId<T>()];
+        if(b == nullptr) {
+            batches.push_back(std::make_unique<B>());
+            b = batches.back().get();
+        }
+        return static_cast<B&>(*b);
+    }
+public:
+    // returns a pending handle, usable with this buffer only
+    entity addEntity() {
+        return makeEntity(pendingCount++, UINT32_MAX);
+    }
+    void removeEntity(entity e) {
+        destroys.push_back(e);
+    }
+    template<typename T, typename ... Args>
+    void addComponent(entity e, Args ... args) {
+        static_assert(std::is_base_of<component<T>, T>::value, "component<T> is undefined\n");
+        batch<AddComponents<T>,T>(addBatches, addsByType).push(e, T(args...));
+    }
+    template<typename T>
+    void removeComponent(entity e) {
+        static_assert(std::is_base_of<component<T>, T>::value, "component<T> is undefined\n");
+        batch<RemoveComponents<T>,T>(removeBatches, removesByType).push(e);
+    }
+    // apply recorded changes to the context, and reset
+    void apply(Context& c);
+};
@@ -1,9 +1,46 @@
 #pragma once
+#include <cassert>
 #include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <atomic>
+#include <bitset>
 #include <memory>
 
 template<typename T>
 class component {
 public:
-    using ptr = std::shared_ptr<T>;
-};
\ No newline at end of file
+    // non-owning: components live packed in their pool, so a ptr is only
+    // valid until the next add / remove of that component type
+    using ptr = T*;
+};
+
+// process-wide index of a component type (dense, in order of first use)
+//     also taken by the tags of system access sets, which share signatures
+constexpr size_t maxComponents = 64;
+inline size_t nextComponentId() {
+    static std::atomic<size_t> next{ 0 };
+    size_t id = next++;
+    // in every build: past it, signatures & pool tables would be indexed out of bounds
+    if(id >= maxComponents) {
+        std::fprintf(stderr, "more than %zu component & access set types\n", maxComponents);
+        std::abort();
+    }
+    return id;
+}
+template<typename T>
+size_t componentId() {
+    static const size_t id = nextComponentId();
+    return id;
+}
+// set of component types, one bit per componentId
+using signature = std::bitset<maxComponents>;
+template<typename ... Ts>
+const signature& signatureOf() {
+    static const signature s = [] {
+        signature r;
+        (r.set(componentId<Ts>()), ...);
+        return r;
+    }();
+    return s;
+}
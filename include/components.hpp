@@ -1,13 +1,17 @@
 #pragma once
 
 #include "component.hpp"
+#include "archetype.hpp"
 #include "utility.hpp"
+#include "tilegrid.hpp"
+#include "tilechunks.hpp"
 
 #include <SDL.h>
 #include "sdl_util.hpp"
 
 #include <vector>
 #include <string>
+#include <memory>
 
 struct name : component<name> {
     std::string str;
@@ -43,6 +47,17 @@ struct mass : component<mass> {
     float m;
     mass(float m) : m(m) {}
 };
+// hot physics components: read together by the integrators, so they are
+// stored in archetype chunks rather than in separate pools
+template<> struct archetypal<position> : std::true_type {};
+template<> struct archetypal<velocity> : std::true_type {};
+template<> struct archetypal<acceleration> : std::true_type {};
+template<> struct archetypal<force> : std::true_type {};
+template<> struct archetypal<mass> : std::true_type {};
+// sleeping body: left out of integration & dynamic collision until woken
+//     archetypal, so sleeping bodies sit in their own chunks and are skipped per chunk
+struct asleep : component<asleep> {};
+template<> struct archetypal<asleep> : std::true_type {};
 struct shoots : component<shoots> {
     unsigned ammo{ 0 };
     tilesetMetaPtr pTS;
@@ -51,10 +66,12 @@ struct shoots : component<shoots> {
 };
 // despawning struct
 struct bullet : component<bullet> {
-    entity shooter{ 0 };
+    entity shooter{ nullEntity };
     bool hit{ false };
     bullet(entity shooter, bool hit) : shooter(shooter), hit(hit) {}
 };
+// fast mover: collides along its whole path in a tick (swept), not only at its end
+struct fast : component<fast> {};
 // entity state specific
 struct direction : component<direction> {
     enum class facing {left, right, up, down} dir;
@@ -83,6 +100,16 @@ struct volume : component<volume> {
     rectf box;
     volume(rectf box) : box(box) {}
 };
+// static tilemap collision boxes, built once at load time (one per map)
+struct terrain : component<terrain> {
+    std::shared_ptr<const TileGrid> grid;
+    terrain(std::shared_ptr<const TileGrid> grid) : grid(grid) {}
+};
+// tilemap layer, drawn from chunks streamed around the camera (one per layer drawn)
+struct tilelayer : component<tilelayer> {
+    std::shared_ptr<TileChunks> chunks;
+    tilelayer(std::shared_ptr<TileChunks> chunks) : chunks(chunks) {}
+};
 // dynamic (indexed) collision box
 struct collide : component<collide> {
     rectf box;
@@ -102,7 +129,7 @@ struct combat : component<combat> {
 struct enemy : component<enemy> {
     enum class state { passive, aggressive };
     state s;
-    entity target = 0;
+    entity target = nullEntity;
     enemy(state s) : s(s) {}
 };
 struct debug : component<debug> {
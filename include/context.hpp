@@ -1,6 +1,13 @@
 #pragma once
 #include <iostream>
+#include <algorithm>
+#include <limits>
+#include <array>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
 #include <memory>
+#include <vector>
 #include <unordered_set>
 #include <unordered_map>
 using std::shared_ptr;
@@ -9,49 +16,233 @@ using std::unordered_map;
 
 #include "entity.hpp"
 #include "component.hpp"
+#include "pool.hpp"
+#include "archetype.hpp"
+#include "view.hpp"
+#include "broadphase.hpp"
+#include "utility.hpp"
+
+// process-wide index of a type of per-context system state (see Context::state),
+// counted apart from components, so states never use up component ids
+constexpr size_t maxStates = 32;
+inline size_t nextStateId() {
+    static std::atomic<size_t> next{ 0 };
+    size_t id = next++;
+    // in every build: past it, the state table would be indexed out of bounds
+    if(id >= maxStates) {
+        std::fprintf(stderr, "more than %zu system state types\n", maxStates);
+        std::abort();
+    }
+    return id;
+}
+template<typename T>
+size_t stateId() {
+    static const size_t id = nextStateId();
+    return id;
+}
 
 class Context {
     // entities
     unordered_set<entity> entities;
-    // components
+    // current generation per entity index, and indices free for reuse
+    std::vector<uint32_t> generations{ 0 };
+    std::vector<uint32_t> freed;
+    // component signature per entity index
+    std::vector<signature> signatures{ signature() };
+    // components (sparse set per component type, indexed by componentId<T>)
+    //     fixed size, so creating one pool never moves another under a reader
+    std::array<std::unique_ptr<PoolBase>,maxComponents> pools;
+    // archetypal components (chunked by component signature)
+    Archetypes bodies;
+    // collision boxes by entity index, kept by the collision system (spatial queries)
+    SweepAndPrune spatial;
+    // entity each box was inserted for & the pass it was inserted in, by index
+    std::vector<entity> owners;
+    std::vector<uint64_t> passes;
+    uint64_t pass{ 0 };
+    // entities boxed in the current pass, and in the last one
+    std::vector<entity> boxing, boxed;
+    // entities left without a box by the last pass, and added since
+    std::vector<entity> loose, fresh;
+    bool boxedThisPass(entity e) const {
+        uint32_t id = entityIndex(e);
+        return id < owners.size() && owners[id] == e && passes[id] == pass;
+    }
+    // entity of a spatial index id, nullEntity if it has since been removed (even if
+    // its index was reused: the box is still the removed entity's until the next pass)
+    entity indexed(uint32_t id) const {
+        entity e = (id < owners.size()) ? owners[id] : nullEntity;
+        return alive(e) ? e : nullEntity;
+    }
+    // state systems keep for this context (system instances are shared by contexts),
+    //     by stateId of its type; fixed size like pools
+    std::array<std::shared_ptr<void>,maxStates> states;
+    // get (or create) the pool of T: only on paths that add components
     template<typename T>
-    inline static unordered_map<entity, typename component<T>::ptr> m{};
+    Pool<T>& m() {
+        size_t id = componentId<T>();
+        if(!pools[id]) pools[id] = std::make_unique<Pool<T>>();
+        return static_cast<Pool<T>&>(*pools[id]);
+    }
+    // get the pool of T, nullptr if none was created (safe to call concurrently)
+    template<typename T>
+    Pool<T>* pool() {
+        if constexpr(archetypal<T>::value) return nullptr;
+        else return static_cast<Pool<T>*>(pools[componentId<T>()].get());
+    }
 public:
-    // add / remove entities
+    // add / remove entities (removing tears down all of the entity's components)
     entity addEntity();
     void removeEntity(entity e);
+    // false for handles whose entity was removed (even if its index was reused)
+    bool alive(entity e) const;
     // get entities
     unordered_set<entity> getEntities();
+    // iterate entities that have all of the components Ts...
+    template<typename ... Ts>
+    View<Ts...> view() {
+        return View<Ts...>(&signatures, &bodies, pool<Ts>()...);
+    }
+    // iterate archetype chunks that have all of the (archetypal) components Ts...
+    //     f(size_t n, entity* es, Ts*... cols)
+    template<typename ... Ts, typename F>
+    void chunks(F&& f) {
+        static_assert((archetypal<Ts>::value && ...), "chunks<Ts...> needs archetypal components\n");
+        bodies.eachChunk<Ts...>(std::forward<F>(f));
+    }
     // add component to entity
     template<typename T, typename ... Args>
     void addComponent(entity e, Args ... args) {
         static_assert(std::is_base_of<component<T>, T>::value, "component<T> is undefined\n");
-        //assert(m<T>.count(e) > 0);
-        m<T>[e] = std::make_shared<T>(args...);
+        if constexpr(archetypal<T>::value) bodies.emplace<T>(e, args...);
+        else m<T>().emplace(e, args...);
+        if(alive(e)) signatures[entityIndex(e)].set(componentId<T>());
+    }
+    // make room for n more components of type T (ahead of a batch of adds)
+    template<typename T>
+    void reserve(size_t n) {
+        if constexpr(!archetypal<T>::value) m<T>().reserve(n);
     }
     template<typename T>
     void copyComponent(entity from, entity to) {
         static_assert(std::is_base_of<component<T>, T>::value, "component<T> is undefined\n");
-        m<T>[to] = std::make_shared<T>(*m<T>[from]);
+        //assert(hasComponents<T>(from));
+        // copy out first: emplacing may move storage under the source
+        T t = *getComponent<T>(from);
+        addComponent<T>(to, t);
     }
-    // get component of entity
+    // get component of entity (nullptr if it has none)
     template<typename T>
     typename component<T>::ptr getComponent(entity e) {
         static_assert(std::is_base_of<component<T>, T>::value, "component<T> is undefined\n");
-        //assert(m<T>.count(e) > 0);
-        return m<T>[e];
+        //assert(hasComponents<T>(e));
+        if constexpr(archetypal<T>::value) return bodies.get<T>(e);
+        else {
+            Pool<T>* p = pool<T>();
+            return (p != nullptr) ? p->get(e) : nullptr;
+        }
     }
     // remove component from entity
-    void removeComponent(entity e);
-    // query if entity has component(s)
+    template<typename T>
+    void removeComponent(entity e) {
+        static_assert(std::is_base_of<component<T>, T>::value, "component<T> is undefined\n");
+        if constexpr(archetypal<T>::value) bodies.remove<T>(e);
+        else if(Pool<T>* p = pool<T>()) p->remove(e);
+        if(alive(e)) signatures[entityIndex(e)].reset(componentId<T>());
+    }
+    // query if entity has component(s): a single mask compare
     template<typename T, typename... Args>
     bool hasComponents(entity e) {
-        static_assert(std::is_base_of<component<T>, T>::value, "component<T> is undefined\n");
-        if constexpr(sizeof...(Args) > 0) {
-            return (m<T>.count(e) > 0) && hasComponents<Args...>(e);
+        static_assert((std::is_base_of<component<T>, T>::value && ... && std::is_base_of<component<Args>, Args>::value),
+            "component<T> is undefined\n");
+        const signature& mask = signatureOf<T, Args...>();
+        return alive(e) && (signatures[entityIndex(e)] & mask) == mask;
+    }
+    // component signature of entity (empty for stale handles)
+    signature getSignature(entity e) const {
+        return alive(e) ? signatures[entityIndex(e)] : signature();
+    }
+    // get (or create) this context's T: only from a system that writes T's owner
+    template<typename T>
+    T& state() {
+        std::shared_ptr<void>& s = states[stateId<T>()];
+        if(!s) s = std::make_shared<T>();
+        return *static_cast<T*>(s.get());
+    }
+    // this context's T, nullptr if none was created (safe to call concurrently)
+    template<typename T>
+    T* findState() {
+        return static_cast<T*>(states[stateId<T>()].get());
+    }
+    // collision box index: filled by the collision system each tick (ids are entity indices)
+    SweepAndPrune& broadphase() { return spatial; }
+    //     a pass: beginIndex(), index() per box, endIndex() (boxes not set again are dropped)
+    void beginIndex();
+    void index(entity e, const rectf& r, bool dynamic) {
+        uint32_t id = entityIndex(e);
+        if(id >= owners.size()) {
+            owners.resize(id+1, nullEntity);
+            passes.resize(id+1, 0);
         }
-        else {
-            return(m<T>.count(e) > 0);
+        if(!boxedThisPass(e)) boxing.push_back(e);
+        owners[id] = e;
+        passes[id] = pass;
+        spatial.insert(id, r, dynamic);
+    }
+    //     sorts the index, out: broadphase candidate pairs
+    void endIndex(std::vector<std::pair<uint32_t,uint32_t>>& candidates);
+    // f(e) for live entities without a box in the index: added since the last pass, or
+    // left out of it (e.g. no collision box); few, so callers can test them directly
+    template<typename F>
+    void eachUnindexed(F&& f) {
+        for(entity e : loose) if(alive(e)) f(e);
+        for(entity e : fresh) if(alive(e)) f(e);
+    }
+    // spatial queries, over the boxes of the last collision pass
+    //     entities whose box overlaps r / the circle
+    std::vector<entity> queryBox(const rectf& r);
+    std::vector<entity> queryCircle(vec2f center, float radius);
+    //     up to k entities with all of Ts... within radius of p, nearest first
+    template<typename ... Ts>
+    std::vector<entity> nearest(vec2f p, size_t k, float radius, entity except = nullEntity) {
+        std::vector<std::pair<float,entity>> found;
+        // grow the search square until it holds k matches: matches within s are
+        // nearer than anything outside it
+        for(float s = std::min(radius, 64.f);; s = std::min(2.f*s, radius)) {
+            found.clear();
+            spatial.query(rectf(p.x - s, p.y - s, 2.f*s, 2.f*s), [&](uint32_t id) {
+                entity e = indexed(id);
+                if(e == nullEntity || e == except) return;
+                if constexpr(sizeof...(Ts) > 0) {
+                    if(!hasComponents<Ts...>(e)) return;
+                }
+                float d = distance(p, spatial.box(id));
+                if(d <= s) found.emplace_back(d, e);
+            });
+            if(found.size() >= k || s >= radius) break;
+        }
+        std::sort(found.begin(), found.end());
+        std::vector<entity> es;
+        for(size_t i = 0; i < found.size() && i < k; ++i) {
+            es.push_back(found[i].second);
         }
+        return es;
+    }
+    //     first entity with all of Ts... on the segment from a to b, and how far
+    //     along it the hit is (in [0,1]); nullEntity if none
+    template<typename ... Ts>
+    std::pair<entity,float> raycast(vec2f a, vec2f b, entity except = nullEntity) {
+        std::pair<entity,float> hit(nullEntity, std::numeric_limits<float>::infinity());
+        vec2f d(b.x - a.x, b.y - a.y);
+        spatial.query(swept(rectf(a.x, a.y, 0.f, 0.f), d), [&](uint32_t id) {
+            entity e = indexed(id);
+            if(e == nullEntity || e == except) return;
+            if constexpr(sizeof...(Ts) > 0) {
+                if(!hasComponents<Ts...>(e)) return;
+            }
+            float t = timeOfImpact(rectf(a.x, a.y, 0.f, 0.f), d, spatial.box(id), vec2f(0.f, 0.f));
+            if(t < hit.second) hit = std::make_pair(e, t);
+        });
+        return hit;
     }
 };
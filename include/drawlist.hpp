@@ -0,0 +1,50 @@
+#pragma once
+#include "sdl_util.hpp"
+
+#include <SDL.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// sprite draws of a frame, in draw order by a packed 64 bit key:
+//     depth (layer z + y, as an order preserving float) | texture id
+// storage and the previous frame's order are reused: draws still present keep
+// their place, new ones are appended, and the list is insertion sorted if that
+// leaves it nearly sorted (few sprites moved), else LSD radix sorted
+class DrawList {
+public:
+    struct Item {
+        uint64_t key;
+        // caller's id (e.g. entity index)
+        uint32_t id;
+        LRenderable r;
+    };
+private:
+    std::vector<Item> items;
+    // this frame's draws not yet placed, and scratch for the radix sort
+    std::vector<Item> added;
+    std::vector<Item> scratch;
+    // id -> frame it was last added in, and its slot in added
+    std::vector<std::pair<uint64_t,uint32_t>> slots;
+    uint64_t frame{ 0 };
+    std::unordered_map<SDL_Texture*,uint32_t> textures;
+    void radixSort();
+    void insertionSort();
+public:
+    // out of order neighbours, per draw, up to which the list is insertion sorted
+    float nearlySorted{ 1.0f/32.0f };
+    // last frame: whether it was insertion sorted
+    bool incremental{ false };
+    // start a frame: draws not added again before sort() are dropped
+    void clear();
+    // one draw per id and frame
+    void add(uint32_t id, float depth, const LRenderable& r);
+    void sort();
+    const std::vector<Item>& draws() const { return items; }
+    size_t size() const { return items.size(); }
+    // small, dense id per texture
+    uint32_t textureId(SDL_Texture* tex);
+    static uint64_t makeKey(float depth, uint32_t texture);
+};
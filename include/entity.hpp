@@ -1,5 +1,15 @@
 #pragma once
 #include <cstddef>
+#include <cstdint>
 
 // entity is an id, nothing more, nothing less
-typedef size_t entity;
\ No newline at end of file
+//     low 32 bits: index into storage, high 32 bits: generation of that index,
+//     bumped whenever the index is recycled so stale handles can be detected
+typedef uint64_t entity;
+// never handed out (index 0 is reserved)
+constexpr entity nullEntity = 0;
+inline uint32_t entityIndex(entity e) { return uint32_t(e); }
+inline uint32_t entityGeneration(entity e) { return uint32_t(e >> 32); }
+inline entity makeEntity(uint32_t index, uint32_t generation) {
+    return (entity(generation) << 32) | index;
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include "tilegrid.hpp"
+#include "utility.hpp"
+
+#include <vector>
+
+// Dijkstra map over the cells of a TileGrid toward one goal: built once per
+// goal (and again only when the goal changes cell), then every chaser samples
+// the way to go in O(1)
+//     8-connected, diagonal steps only between two free orthogonal neighbours
+class FlowField {
+    const TileGrid* grid{ nullptr };
+    int goalX{ -1 }, goalY{ -1 };
+    // path cost to the goal per cell (infinity: blocked or unreachable)
+    std::vector<float> cost;
+    // cell containing p
+    int cellX(float x) const;
+    int cellY(float y) const;
+    float at(int x, int y) const;
+public:
+    // (re)build toward target, unless it is still in the goal cell of the same grid
+    //     returns whether a rebuild happened
+    bool build(const TileGrid& g, vec2f target);
+    // unit direction from p toward the next cell on its shortest path to the goal
+    //     (0,0) in the goal cell, or where the goal cannot be reached
+    vec2f direction(vec2f p) const;
+};
@@ -0,0 +1,14 @@
+#pragma once
+#include <cstddef>
+
+// integration over n bodies, in two steps around collision resolution:
+//     accelerate: a = F/m, v += a*dt   (collision then predicts with the new velocity)
+//     advance:    p += v*dt            (with the velocity collision resolution left)
+//     p, v, a, f are interleaved x/y pairs (x0,y0,x1,y1,...), m is one float per body
+//     (the layout of archetype chunk columns of {x,y} components)
+// scalar references
+void accelerateScalar(size_t n, float* v, float* a, const float* f, const float* m, float dt);
+void advanceScalar(size_t n, float* p, const float* v, float dt);
+// SSE2, or AVX2 when compiled with it (__AVX2__); match the scalar paths
+void accelerate(size_t n, float* v, float* a, const float* f, const float* m, float dt);
+void advance(size_t n, float* p, const float* v, float dt);
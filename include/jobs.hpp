@@ -0,0 +1,53 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// work-stealing pool: every worker owns a deque of jobs, taking from its back
+// and stealing from the front of the others' when it runs dry. threads outside
+// the pool submit into a shared deque that workers steal from as well.
+class ThreadPool {
+    struct Queue {
+        std::mutex m;
+        std::deque<std::function<void()>> jobs;
+    };
+    // one per worker, plus the shared one for outside threads (last)
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+    // queued (not yet taken) jobs, sleeping workers wait for this to be non-zero
+    std::atomic<size_t> queued{ 0 };
+    bool stopping{ false };
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    void work(size_t self);
+    // queue of the calling thread (the shared one for outside threads)
+    size_t home() const;
+    // take a job: own queue first (newest), then steal from the others (oldest)
+    bool take(size_t self, std::function<void()>& job);
+public:
+    // one worker per core besides the calling thread
+    static unsigned defaultWorkers();
+    ThreadPool(unsigned numWorkers = defaultWorkers());
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    // run every job, returning once all have finished (the caller helps out,
+    // so jobs may themselves call run)
+    void run(std::vector<std::function<void()>>& jobs);
+    unsigned size() const { return unsigned(workers.size()); }
+    // f(entity, Ts&...) for every entity of the view, split into blocks
+    // (archetype chunks, or runs of pooled entities) that run in parallel.
+    //     f must only touch the components it is handed
+    template<typename V, typename F>
+    void parallel_for(V&& view, F&& f) {
+        std::vector<std::function<void()>> jobs = view.blocks(f);
+        run(jobs);
+    }
+};
@@ -21,8 +21,10 @@
 struct tilemapMeta {
     // tmx::tilemap containing all metadata from TMX file
     tmx::tilemap tm;
-    // finished tilemap layers
-    std::vector<SDL_Texture*> layers;
+    // tilemap layers (chunk textures rendered on demand)
+    std::vector<std::shared_ptr<TileChunks>> layers;
+    // largest tile edge of the sprite sheets its objects use (pixels)
+    unsigned spriteExtent{ 0 };
     tilemapMeta() {}
 };
 using tilemapMetaPtr = std::shared_ptr<tilemapMeta>;
@@ -35,12 +37,23 @@ class Loader {
     std::unordered_map<std::string,tilemapMetaPtr> tilemapMetas;
     // created contexts
     std::unordered_map<std::string,std::shared_ptr<Context>> contexts;
+    // merge adjacent static collision boxes at populate time
+    bool mergeCollision{ true };
+    // tileset images loaded but not yet packed into the atlas
+    std::vector<std::pair<tilesetMetaPtr,SDL_Surface*>> unpacked;
+    // atlas pages holding every tileset & sprite sheet image
+    std::vector<SDL_Texture*> atlasPages;
+    // atlas page edge (at most the renderer's largest texture)
+    int atlasPageSize{ 2048 };
+    // tilemap layer chunk edge (pixels, rounded down to whole tiles)
+    unsigned chunkSize{ 512 };
 public:
     // init resource directory, init tinytmx lib
     Loader(const std::string& resourceDirectory);
     // populate tilemaps & entity metas (basically, just know what to do with textures)
     void loadTilemap(const std::string& filename, const std::string& mapname);
     // create textures based on tilemap & entity metas (using the passed renderer)
+    //     tilemap layers are only split into chunks here, rendered later as they are drawn
     void populateTilemap(const std::string& mapname, SDL_Renderer* renderer);
     // de-allocate any textures manually
     void destroySDLTextures();
@@ -48,9 +61,20 @@ public:
     std::shared_ptr<Context> getTilemapContext(const std::string& mapname);
     // get size of a tilemap's base layer
     std::pair<unsigned,unsigned> getTilemapSize(const std::string& mapname);
+    // get size of a tilemap's tiles
+    std::pair<unsigned,unsigned> getTileSize(const std::string& mapname);
+    // how far a sprite of the tilemap may reach beyond its collision box (world units):
+    //     its sheet's largest tile edge (object & tile collision boxes lie within the tile)
+    float getSpriteReach(const std::string& mapname);
+    // toggle merging of static collision boxes (off: one box per tile box, for comparison)
+    void setCollisionMerging(bool merge) { mergeCollision = merge; }
 private:
+    // merge adjacent static collision boxes into maximal rectangles
+    static std::vector<rectf> mergeBoxes(std::vector<rectf> boxes);
     // create collision boxes
     tileMetaPtr loadTile(tmx::tile t);
-    // parse tileset into into SDL_Texture
+    // parse tileset, queue its image for the atlas
     tilesetMetaPtr loadTileset(tmx::tileset ts, SDL_Renderer* renderer);
+    // pack queued tileset images into new atlas pages, point their tilesets there
+    void packAtlas(SDL_Renderer* renderer);
 };
\ No newline at end of file
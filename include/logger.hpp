@@ -2,13 +2,26 @@
 
 #include <string>
 #include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
 
 class Logger {
     bool firstlog = true;
     std::string filename;
     std::ofstream ofs;
+    // other threads log into their own buffers, written out by sync()
+    std::thread::id owner;
+    std::mutex buffersMutex;
+    std::vector<std::unique_ptr<std::ostringstream>> buffers;
 public:
     Logger(std::string logfilename);
     ~Logger();
-    std::ofstream& get();
-};
\ No newline at end of file
+    // stream for the calling thread
+    std::ostream& get();
+    // append buffered output of other threads to the log
+    //     (call from the owning thread, while no other thread is logging)
+    void sync();
+};
@@ -0,0 +1,81 @@
+#pragma once
+#include <cstddef>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "entity.hpp"
+
+// type-erased interface, so a context can own (and tear down) pools of any type
+class PoolBase {
+public:
+    virtual ~PoolBase() {}
+    virtual bool has(entity e) const = 0;
+    virtual void remove(entity e) = 0;
+    virtual size_t size() const = 0;
+};
+
+// sparse set of components of a single type:
+//     dense holds the components contiguously, owners holds the entity of each
+//     dense slot, and sparse maps an entity index back to its dense slot
+template<typename T>
+class Pool : public PoolBase {
+    static constexpr size_t npos = std::numeric_limits<size_t>::max();
+    std::vector<size_t> sparse;
+    std::vector<T> dense;
+    std::vector<entity> owners;
+public:
+    // query if entity has a component in this pool
+    //     (stale handles of a recycled index do not match the owner)
+    bool has(entity e) const override {
+        uint32_t i = entityIndex(e);
+        return i < sparse.size() && sparse[i] != npos && owners[sparse[i]] == e;
+    }
+    // construct component in place (overwrites an existing one)
+    template<typename ... Args>
+    T& emplace(entity e, Args&& ... args) {
+        uint32_t i = entityIndex(e);
+        if(i < sparse.size() && sparse[i] != npos) {
+            T& t = dense[sparse[i]];
+            t = T(std::forward<Args>(args)...);
+            owners[sparse[i]] = e;
+            return t;
+        }
+        if(i >= sparse.size()) sparse.resize(i+1, npos);
+        sparse[i] = dense.size();
+        dense.emplace_back(std::forward<Args>(args)...);
+        owners.push_back(e);
+        return dense.back();
+    }
+    // get component of entity, nullptr if it has none
+    T* get(entity e) {
+        return has(e) ? &dense[sparse[entityIndex(e)]] : nullptr;
+    }
+    // get component of entity known to be in the pool
+    T& at(entity e) {
+        return dense[sparse[entityIndex(e)]];
+    }
+    // remove component: swap the last slot into the hole to stay packed
+    void remove(entity e) override {
+        if(!has(e)) return;
+        size_t i = sparse[entityIndex(e)];
+        size_t last = dense.size() - 1;
+        if(i != last) {
+            dense[i] = std::move(dense[last]);
+            owners[i] = owners[last];
+            sparse[entityIndex(owners[i])] = i;
+        }
+        dense.pop_back();
+        owners.pop_back();
+        sparse[entityIndex(e)] = npos;
+    }
+    size_t size() const override { return dense.size(); }
+    // make room for n more components
+    void reserve(size_t n) {
+        dense.reserve(dense.size() + n);
+        owners.reserve(owners.size() + n);
+    }
+    // packed views, index-aligned with each other
+    const std::vector<entity>& entities() const { return owners; }
+    std::vector<T>& components() { return dense; }
+};
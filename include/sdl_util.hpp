@@ -37,11 +37,14 @@ struct tilesetMeta {
     unsigned numRows;
     unsigned tilewidth;
     unsigned tileheight;
+    // where the tileset's image sits in tex (an atlas page)
+    int x{ 0 };
+    int y{ 0 };
     tilesetMeta() {}
     inline SDL_Rect get(unsigned i, unsigned j) {
         SDL_Rect r;
-        r.x = j*tilewidth;
-        r.y = i*tileheight;
+        r.x = x + j*tilewidth;
+        r.y = y + i*tileheight;
         r.w = tilewidth;
         r.h = tileheight;
         return r;
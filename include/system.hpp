@@ -1,10 +1,55 @@
 #pragma once
 #include "context.hpp"
+#include "jobs.hpp"
 
+#include <functional>
+#include <string>
+#include <vector>
+
+// declared access sets of a system: component types, or any other type used
+// as a tag for shared state (e.g. the system struct owning that state)
+template<typename ... Ts>
+struct reads {
+    static signature set() { return signatureOf<Ts...>(); }
+};
+template<typename ... Ts>
+struct writes {
+    static signature set() { return signatureOf<Ts...>(); }
+};
+
+// Derived declares `using read = reads<...>;` and `using write = writes<...>;`
 template<typename Derived>
 class System {
 public:
     void update(Context& c) {
         static_cast<Derived*>(this)->update(c);
     }
-};
\ No newline at end of file
+    static signature readSet() { return Derived::read::set(); }
+    static signature writeSet() { return Derived::write::set(); }
+};
+
+// runs systems in registration order, except that systems whose access sets
+// do not conflict run at the same time. each system lands in the first wave
+// after every earlier system it conflicts with, so the outcome is the same
+// as running them one after the other.
+class Scheduler {
+    struct Task {
+        std::string name;
+        signature read, write;
+        std::function<void()> run;
+        size_t wave;
+    };
+    ThreadPool& pool;
+    std::vector<Task> tasks;
+    std::vector<std::vector<std::function<void()>>> waves;
+    void addTask(const std::string& name, signature read, signature write, std::function<void()> run);
+public:
+    Scheduler(ThreadPool& pool) : pool(pool) {}
+    // schedule a call into system S (with S's declared access sets)
+    template<typename S, typename F>
+    void add(const std::string& name, F&& run) {
+        addTask(name, S::readSet(), S::writeSet(), std::function<void()>(std::forward<F>(run)));
+    }
+    // run all waves, in order
+    void run();
+};
@@ -1,49 +1,107 @@
 #pragma once
 
 #include "system.hpp"
+#include "command.hpp"
 
 #include "components.hpp"
+#include "broadphase.hpp"
+#include "flowfield.hpp"
+#include "drawlist.hpp"
 
 #include <SDL.h>
 #include <SDL_ttf.h>
 
 #include <map>
+#include <unordered_map>
 #include <list>
 #include <vector>
 #include <utility>
 #include <deque>
 
 namespace systems {
-    // position system
-    struct Position {
-        void update(Context &c, float dt);
-    };
-    // velocity system
-    struct Velocity {
-        void update(Context &c, float dt);
+    // deferred entity / component changes to c, applied by the main loop at sync points
+    //     per-entity state of the systems below is kept per context too (their State)
+    inline CommandBuffer& commands(Context& c) { return c.state<CommandBuffer>(); }
+    // systems that own shared state (also used as tags in access sets)
+    struct Camera;
+    struct Graphics;
+    struct Bullet;
+    struct Debug;
+    struct Collision;
+    // physics integration, in two steps around collision resolution:
+    //     accelerate: a = F/m, v += a*dt, so collision predicts and clips the
+    //     motion the body will actually make; move: p += v*dt, with the velocity
+    //     collision left. bodies with every component go through the SIMD kernels,
+    //     one chunk per job; the rest take whichever stages apply
+    //     (sleeping bodies are skipped)
+    struct Integrator : System<Integrator> {
+        using read = reads<force,mass,asleep>;
+        using write = writes<acceleration,velocity,position>;
+        void accelerate(Context& c, float dt);
+        void move(Context& c, float dt);
     };
-    // acceleration system
-    struct Acceleration {
-        void update(Context &c);
+    // body sleeping: bodies idle for a while are tagged asleep (at the next sync
+    // point), and woken once their velocity / force is written or on contact
+    struct Sleep : System<Sleep> {
+        using read = reads<velocity,force,asleep>;
+        using write = writes<Sleep,CommandBuffer>;
+        // speed & force magnitude below which a body counts as idle
+        float threshold{ 0.5f };
+        // idle ticks before a body goes to sleep
+        unsigned ticks{ 30 };
+        struct State {
+            // consecutive idle ticks of each body, by entity index
+            std::vector<std::pair<entity,unsigned>> idle;
+        };
+        void update(Context& c);
+        // wake e at the next sync point (no-op if it is awake)
+        void wake(Context& c, entity e);
     };
-    struct Force {
+    extern Sleep sleeper;
+    struct Force : System<Force> {
+        using read = reads<>;
+        using write = writes<force>;
         void update(Context &c, float dt);
     };
     // player input system (use velocity to update)
-    struct Input {
+    struct Input : System<Input> {
+        using read = reads<input,position,shoots,sprite,Camera,Collision>;
+        using write = writes<velocity,direction,camera,cursor,Bullet,Debug>;
         bool debugToggle = false;
         bool Wd = false, Ad = false, Sd = false, Dd = false;
         float mouseX{ 0.0f }, mouseY { 0.0f };
         bool mouseLeftd = false, mouseRightd = false;
         bool mousePressing = false;
         bool upArr = false, downArr = false;
-        void update(Context &c); 
+        // entity under the mouse (nullEntity if none)
+        entity hovered{ nullEntity };
+        void update(Context &c, float dt); 
     };
-    struct Direction {
+    struct Direction : System<Direction> {
+        using read = reads<direction>;
+        using write = writes<sprite>;
         void update(Context &c);
     };
+    // render interpolation between the previous and current simulation tick
+    struct Interpolation : System<Interpolation> {
+        using read = reads<position,velocity>;
+        using write = writes<Interpolation>;
+        struct State {
+            // position of each moving entity before the latest tick, by entity index
+            std::vector<std::pair<entity,vec2f>> previous;
+        };
+        // fraction of a tick elapsed since the latest one, in [0,1)
+        float alpha{ 1.0f };
+        // record positions ahead of a tick
+        void snapshot(Context& c);
+        // position to draw e at (current position if it has no snapshot)
+        vec2f at(Context& c, entity e);
+    };
+    extern Interpolation interp;
     // rendering systems
-    struct Camera {
+    struct Camera : System<Camera> {
+        using read = reads<camera,position,volume,Interpolation>;
+        using write = writes<Camera>;
         unsigned vw{0};
         unsigned vh{0};
         float cx{0.0f};
@@ -52,46 +110,175 @@ namespace systems {
         void update(Context &c, SDL_Renderer& r);
         std::pair<float,float> getWorldCoordinates(float x, float y);
         std::pair<float,float> getCameraCoordinates(float x, float y);
+        // world rectangle on screen
+        rectf getWorldView();
+        // entities with all of Ts... that may be on screen, grown by margin (world units):
+        //     indexed ones by a spatial query around the view, plus the few without a
+        //     box in the index (spawned since the last pass, or no collision box), which
+        //     all pass (callers test them exactly)
+        //     margin must cover how far what is drawn reaches beyond the indexed box,
+        //     including motion since the last pass; anything reaching further is missed
+        template<typename ... Ts>
+        std::vector<entity> inView(Context& c, float margin) {
+            rectf v = getWorldView();
+            rectf around(v.x - margin, v.y - margin, v.w + 2.f*margin, v.h + 2.f*margin);
+            std::vector<entity> es;
+            for(entity e : c.queryBox(around)) {
+                if(c.hasComponents<Ts...>(e)) es.push_back(e);
+            }
+            c.eachUnindexed([&](entity e) {
+                if(c.hasComponents<Ts...>(e)) es.push_back(e);
+            });
+            return es;
+        }
     };
     extern Camera cam;
+    // tilemap layers: streams their chunks around the view, requests draws of the
+    // ones on screen (ahead of sprites, so layers stay beneath them)
+    struct Layers : System<Layers> {
+        using read = reads<position,Camera>;
+        using write = writes<tilelayer,Graphics>;
+        // texture memory for chunks, shared by all layers (bytes)
+        size_t budget{ size_t(64) << 20 };
+        // distance around the view within which chunks are rendered ahead (world units)
+        float prefetchMargin{ 256.0f };
+        void update(Context& c, SDL_Renderer& r);
+    };
+    extern Layers lay;
     // organize entities by depth & layer, request draws
-    struct Sprite {
+    //     on screen sprites go through a draw list kept between frames, ordered by
+    //     depth (z + y) then texture
+    struct Sprite : System<Sprite> {
+        using read = reads<position,sprite,volume,collide,Camera,Interpolation,Collision>;
+        using write = writes<Sprite,Graphics>;
+        struct State {
+            DrawList list;
+        };
+        // how far a sprite may reach beyond its collision box (world units): the
+        // largest sprite tile edge (Loader::getSpriteReach)
+        float reach{ 0.0f };
+        // slack for motion between the indexed box and the drawn position (world units)
+        float cullMargin{ 64.0f };
+        // last frame: sprites drawn
+        unsigned drawn{ 0 };
         void update(Context &c);
     };
     extern Sprite spr;
     // request UI draws
-    struct UI {
+    struct UI : System<UI> {
+        using read = reads<position,combat,volume,collide,Camera,Interpolation,Collision>;
+        using write = writes<Graphics>;
+        // slack for motion between the indexed box and the drawn position (world
+        // units); a label's own reach is the longest label's size at this zoom
+        float cullMargin{ 64.0f };
         TTF_Font* font;
         void update(Context& c, SDL_Renderer& r);
     };
     extern UI ui;
     // draws the current rendering queue
-    struct Graphics {
+    //     quads are batched per texture and each batch is one SDL_RenderGeometry
+    //     call; a quad joins an earlier batch of its texture only if it overlaps
+    //     nothing queued in between, so the result matches drawing in queue order
+    struct Graphics : System<Graphics> {
+        using read = reads<>;
+        using write = writes<Graphics>;
         std::deque<LRenderable> renderQueue;
+        // how many batches back a quad may join
+        size_t lookback{ 8 };
+        // last frame: draw calls made, quads drawn
+        unsigned drawCalls{ 0 };
+        unsigned quads{ 0 };
         void update(SDL_Renderer& r);
+    private:
+        struct Batch {
+            SDL_Texture* tex;
+            // bounds of the batch's destination rects
+            SDL_Rect bounds;
+            std::vector<LRenderable> quads;
+        };
+        std::vector<Batch> batches;
+        std::vector<SDL_Vertex> vertices;
+        std::vector<int> indices;
     };
     extern Graphics graphics;
-    struct Collision {
+    // contact between two entities over consecutive ticks (a < b)
+    struct contact {
+        enum class phase { begin, stay, end };
+        entity a, b;
+        phase state;
+    };
+    struct Collision : System<Collision> {
+        using read = reads<sprite,volume,terrain,fast,asleep,friction,mass>;
+        using write = writes<collide,position,velocity,bullet,combat,Collision,Sleep,CommandBuffer>;
+        struct State {
+            // broadphase candidates (the broadphase itself is the context's spatial index)
+            std::vector<std::pair<uint32_t,uint32_t>> candidates;
+            // entity index -> slot of its box in the current resolve
+            std::vector<uint32_t> slots;
+            // pairs in contact after the last resolve (sorted), and the events it produced
+            std::vector<std::pair<entity,entity>> touching;
+            std::vector<contact> contacts;
+        };
         // Update collision components, if applicable
         void update(Context& c);
         // Collision Resolution
         void resolve(Context& c, float dt);
+        // contact events of c's last resolve (none before the first)
+        static const std::vector<contact>& contacts(Context& c);
     };
+    extern Collision collider;
     // CombatAI
-    //     needs to register interest in collision events
-    struct CombatAI {
-        std::map<entity,entity> targets;
-        void update(Context& c);
+    //     targets combatants in view, or that it runs into (contact events)
+    //     enemies think in time slices: each one is due every `period` ticks, by
+    //     distance to the camera target, and each tick works through the due ones
+    //     (most overdue first) until the microsecond budget is spent
+    struct CombatAI : System<CombatAI> {
+        using read = reads<position,volume,enemy,combat,acceleration,camera,terrain,Collision>;
+        using write = writes<velocity,CombatAI>;
+        // distance at which an enemy notices a combatant
+        float aggroRadius{ 16.0f*5.0f };
+        // per tick time budget for thinking (microseconds)
+        float budget{ 1000.0f };
+        // distance to the camera target below which an enemy thinks every tick;
+        // the period doubles with every doubling of distance beyond, up to maxPeriod
+        float nearDistance{ 16.0f*10.0f };
+        unsigned maxPeriod{ 8 };
+        // scheduling state per enemy: rate chosen, tick it last thought / is due
+        struct agent {
+            unsigned period{ 1 };
+            uint64_t last{ 0 };
+            uint64_t due{ 0 };
+        };
+        struct State {
+            std::map<entity,entity> targets;
+            // one flow field per chased target, shared by all of its chasers
+            std::map<entity,FlowField> fields;
+            std::unordered_map<entity,agent> agents;
+            uint64_t tick{ 0 };
+        };
+        // last tick: enemies that thought / were left due, and time spent (microseconds)
+        size_t thought{ 0 };
+        size_t deferred{ 0 };
+        float spent{ 0.0f };
+        void update(Context& c, float dt);
+    private:
+        // think for one enemy, dt: time since it last thought
+        void think(Context& c, State& s, entity e, float dt);
     };
     // bullet spawner
-    struct Bullet {
-        std::deque<std::pair<entity,vec2f>> shotsToFire;
-        std::list<entity> bullets;
+    struct Bullet : System<Bullet> {
+        using read = reads<position,shoots,velocity,bullet,Collision>;
+        using write = writes<Bullet,CommandBuffer>;
+        struct State {
+            std::deque<std::pair<entity,vec2f>> shotsToFire;
+        };
         void update(Context& c);
     };
     extern Bullet bul;
     // Debug
-    struct Debug {
+    struct Debug : System<Debug> {
+        using read = reads<>;
+        using write = writes<Debug>;
         bool showCollision{ false };
         void update(Context& c);
     };
@@ -0,0 +1,67 @@
+#pragma once
+#include "utility.hpp"
+
+#include <SDL.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+// a tilemap layer drawn from fixed size chunk textures instead of one map sized one:
+//     chunks are rendered from the tile data when they come near the view, and the
+//     least recently used ones are destroyed once their textures exceed a budget,
+//     so texture memory follows the screen size rather than the map size
+class TileChunks {
+public:
+    // tile gid (flip bits cleared) -> texture & source rect
+    using TileSource = std::function<std::pair<SDL_Texture*,SDL_Rect>(unsigned)>;
+private:
+    struct Chunk {
+        SDL_Texture* tex{ nullptr };
+        // frame it was last near the view / drawn in
+        uint64_t used{ 0 };
+        uint64_t drawn{ 0 };
+    };
+    // gids by row, column (Tiled flip bits included)
+    std::vector<std::vector<unsigned>> gids;
+    unsigned tileW, tileH;
+    // map size, chunk size (whole tiles) & chunk grid (pixels / chunks)
+    unsigned mapW, mapH;
+    unsigned chunkW, chunkH;
+    unsigned cols, rows;
+    TileSource source;
+    std::vector<Chunk> chunks;
+    // chunks holding a texture, and its total size (bytes)
+    std::vector<size_t> resident;
+    size_t bytes{ 0 };
+    uint64_t frame{ 0 };
+    // chunks to draw for the last view
+    std::vector<size_t> visible;
+    // chunk range overlapping r (empty if c0 > c1 or r0 > r1)
+    void range(const rectf& r, int& c0, int& c1, int& r0, int& r1) const;
+    void render(SDL_Renderer& r, size_t k);
+    void evict(size_t budget);
+public:
+    TileChunks(std::vector<std::vector<unsigned>> gids, unsigned tileW, unsigned tileH,
+        TileSource source, unsigned chunkSize = 512);
+    // chunks rendered ahead per frame, outside the view
+    unsigned prefetch{ 2 };
+    // make the chunks over view resident (rendering missing ones), render up to
+    // prefetch more within margin of it while under budget (bytes), then destroy
+    // least recently used chunks until within budget, sparing the ones over view
+    //     view & margin in layer pixels
+    void stream(SDL_Renderer& r, const rectf& view, float margin, size_t budget);
+    // chunks over the last streamed view
+    const std::vector<size_t>& drawn() const { return visible; }
+    SDL_Texture* texture(size_t k) const { return chunks[k].tex; }
+    // chunk rect in layer pixels
+    SDL_Rect bounds(size_t k) const;
+    unsigned width() const { return mapW; }
+    unsigned height() const { return mapH; }
+    size_t residentBytes() const { return bytes; }
+    size_t residentChunks() const { return resident.size(); }
+    // destroy every chunk texture (before the renderer goes)
+    void release();
+};
@@ -0,0 +1,66 @@
+#pragma once
+#include "utility.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// static collision boxes of a tilemap, bucketed by tile cell.
+//     boxes are kept in world coordinates and listed in every cell they overlap
+//     (cells are stored compressed: cellStart[k]..cellStart[k+1] index cellBoxes)
+class TileGrid {
+    unsigned width, height;
+    float tilewidth, tileheight;
+    std::vector<rectf> boxes;
+    std::vector<uint32_t> cellStart;
+    std::vector<uint32_t> cellBoxes;
+    // inclusive cell range overlapped by r, clamped to the map (false if outside)
+    //     a box ending exactly on a cell edge does not reach into the next cell
+    bool cells(const rectf& r, int& x0, int& y0, int& x1, int& y1) const {
+        int fx = int(std::floor(r.x/tilewidth)), fy = int(std::floor(r.y/tileheight));
+        x0 = std::max(0, fx);
+        y0 = std::max(0, fy);
+        x1 = std::min(int(width)-1, std::max(fx, int(std::ceil((r.x + r.w)/tilewidth)) - 1));
+        y1 = std::min(int(height)-1, std::max(fy, int(std::ceil((r.y + r.h)/tileheight)) - 1));
+        return x0 <= x1 && y0 <= y1;
+    }
+public:
+    TileGrid(unsigned width, unsigned height, float tilewidth, float tileheight);
+    // add a world-space box (before build)
+    void add(const rectf& box);
+    // bucket the added boxes by cell
+    void build();
+    const std::vector<rectf>& getBoxes() const { return boxes; }
+    // grid dimensions (in cells) and cell size
+    unsigned columns() const { return width; }
+    unsigned rows() const { return height; }
+    float cellWidth() const { return tilewidth; }
+    float cellHeight() const { return tileheight; }
+    // does any static box reach into cell (x, y)? (outside the map counts as blocked)
+    bool blocked(int x, int y) const {
+        if(x < 0 || y < 0 || x >= int(width) || y >= int(height)) return true;
+        size_t k = size_t(y)*width + x;
+        return cellStart[k+1] > cellStart[k];
+    }
+    // f(const rectf&) for boxes in the cells r overlaps
+    //     (a box spanning several of those cells is visited once per cell)
+    template<typename F>
+    void query(const rectf& r, F&& f) const {
+        int x0, y0, x1, y1;
+        if(!cells(r, x0, y0, x1, y1)) return;
+        for(int y = y0; y <= y1; ++y) {
+            for(int x = x0; x <= x1; ++x) {
+                size_t k = size_t(y)*width + x;
+                for(uint32_t b = cellStart[k]; b < cellStart[k+1]; ++b) {
+                    f(boxes[cellBoxes[b]]);
+                }
+            }
+        }
+    }
+    // does r overlap any static box?
+    bool collides(const rectf& r) const;
+    // earliest time of impact of r moving by d against the static boxes (infinity if none)
+    float timeOfImpact(const rectf& r, vec2f d) const;
+};
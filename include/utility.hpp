@@ -1,5 +1,8 @@
 #pragma once
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
 #include <utility>
 
 // for 2D quantities
@@ -56,4 +59,38 @@ template<typename T>
 bool collision(rect<T> r1, rect<T> r2) {
     return (r1.x < r2.x + r2.w && r1.x + r1.w > r2.x &&
             r1.y < r2.y + r2.h && r1.y + r1.h > r2.y);
-}
\ No newline at end of file
+}
+// box covering r at both ends of a move by d
+inline rectf swept(rectf r, vec2f d) {
+    return rectf(std::min(r.x, r.x + d.x), std::min(r.y, r.y + d.y),
+                 r.w + std::fabs(d.x), r.h + std::fabs(d.y));
+}
+// swept collision: first time t in [0,1] at which r1 moving by d1 overlaps r2
+// moving by d2 (0 if they already overlap), infinity if they do not meet
+inline float timeOfImpact(rectf r1, vec2f d1, rectf r2, vec2f d2) {
+    const float never = std::numeric_limits<float>::infinity();
+    // move in r2's frame
+    float d[2] = { d1.x - d2.x, d1.y - d2.y };
+    float lo1[2] = { r1.x, r1.y }, hi1[2] = { r1.x + r1.w, r1.y + r1.h };
+    float lo2[2] = { r2.x, r2.y }, hi2[2] = { r2.x + r2.w, r2.y + r2.h };
+    float enter = 0.f, exit = 1.f;
+    for(int k = 0; k < 2; ++k) {
+        if(d[k] == 0.f) {
+            if(hi1[k] <= lo2[k] || lo1[k] >= hi2[k]) return never;
+            continue;
+        }
+        float t0 = (lo2[k] - hi1[k]) / d[k];
+        float t1 = (hi2[k] - lo1[k]) / d[k];
+        if(t0 > t1) std::swap(t0, t1);
+        enter = std::max(enter, t0);
+        exit = std::min(exit, t1);
+        if(enter >= exit) return never;
+    }
+    return enter;
+}
+// distance from p to the nearest point of r (0 inside)
+inline float distance(vec2f p, rectf r) {
+    float dx = std::max(std::max(r.x - p.x, 0.f), p.x - (r.x + r.w));
+    float dy = std::max(std::max(r.y - p.y, 0.f), p.y - (r.y + r.h));
+    return std::sqrt(dx*dx + dy*dy);
+}
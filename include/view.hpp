@@ -0,0 +1,110 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <limits>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include "entity.hpp"
+#include "component.hpp"
+#include "pool.hpp"
+#include "archetype.hpp"
+
+// iterates entities that have every component in Ts..., handing out
+// references to their components.
+//     all archetypal: streams the matching archetype chunks linearly
+//     otherwise:      walks the smallest pool among Ts, filters by signature
+//                     mask and looks up the rest
+//     the callback must not add / remove components of types in Ts...
+template<typename ... Ts>
+class View {
+    const std::vector<signature>* signatures;
+    Archetypes* bodies;
+    std::tuple<Pool<Ts>*...> pools;
+    static constexpr bool chunked = (archetypal<Ts>::value && ...);
+    template<typename T>
+    T& get(entity e) {
+        if constexpr(archetypal<T>::value) return *bodies->template get<T>(e);
+        else return std::get<Pool<T>*>(pools)->at(e);
+    }
+    // entities of the smallest (non-archetypal) pool
+    const std::vector<entity>& lead() const {
+        const std::vector<entity>* l = nullptr;
+        size_t n = std::numeric_limits<size_t>::max();
+        auto pick = [&](auto* p) {
+            if(p != nullptr && p->size() < n) {
+                n = p->size();
+                l = &p->entities();
+            }
+        };
+        (pick(std::get<Pool<Ts>*>(pools)), ...);
+        return *l;
+    }
+public:
+    // pools of archetypal types are nullptr
+    View(const std::vector<signature>* signatures, Archetypes* bodies, Pool<Ts>* ... ps)
+        : signatures(signatures), bodies(bodies), pools(ps...) {}
+    // a pooled type that was never added to anything: nothing can match
+    bool empty() const {
+        return ((!archetypal<Ts>::value && std::get<Pool<Ts>*>(pools) == nullptr) || ...);
+    }
+    // pooled entities per block when splitting a view for parallel_for
+    static constexpr size_t blockSize = 1024;
+    // split each(f) into independent jobs: one per archetype chunk, or one per
+    // blockSize run of the lead pool (f is referenced, not copied)
+    template<typename F>
+    std::vector<std::function<void()>> blocks(F& f) {
+        std::vector<std::function<void()>> jobs;
+        if constexpr(chunked) {
+            bodies->template eachChunk<Ts...>([&f, &jobs](size_t n, entity* es, Ts* ... cols) {
+                jobs.emplace_back([&f, n, es, cols...] {
+                    for(size_t i = 0; i < n; ++i) {
+                        f(es[i], cols[i]...);
+                    }
+                });
+            });
+        }
+        else {
+            if(empty()) return jobs;
+            const std::vector<entity>& es = lead();
+            for(size_t b = 0; b < es.size(); b += blockSize) {
+                size_t end = std::min(es.size(), b + blockSize);
+                jobs.emplace_back([this, &f, &es, b, end] {
+                    const signature& mask = signatureOf<Ts...>();
+                    for(size_t i = b; i < end; ++i) {
+                        entity e = es[i];
+                        if(((*signatures)[entityIndex(e)] & mask) == mask) {
+                            f(e, get<Ts>(e)...);
+                        }
+                    }
+                });
+            }
+        }
+        return jobs;
+    }
+    // f(entity, Ts&...)
+    template<typename F>
+    void each(F&& f) {
+        if constexpr(chunked) {
+            bodies->template eachChunk<Ts...>([&f](size_t n, entity* es, Ts* ... cols) {
+                for(size_t i = 0; i < n; ++i) {
+                    f(es[i], cols[i]...);
+                }
+            });
+        }
+        else {
+            if(empty()) return;
+            const signature& mask = signatureOf<Ts...>();
+            const std::vector<entity>& es = lead();
+            for(size_t i = 0; i < es.size(); ++i) {
+                entity e = es[i];
+                // pooled entities are alive, so their signature slot is current
+                if(((*signatures)[entityIndex(e)] & mask) == mask) {
+                    f(e, get<Ts>(e)...);
+                }
+            }
+        }
+    }
+};
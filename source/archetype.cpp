@@ -0,0 +1,108 @@
+#include "archetype.hpp"
+
+#include <atomic>
+#include <cassert>
+
+// registered column sizes, indexed by column id
+std::array<size_t,Archetypes::maxColumns>& Archetypes::columnSizes() {
+    static std::array<size_t,maxColumns> sizes{};
+    return sizes;
+}
+size_t Archetypes::registerColumn(size_t size) {
+    static std::atomic<size_t> next{ 0 };
+    size_t id = next++;
+    assert(id < maxColumns);
+    columnSizes()[id] = size;
+    return id;
+}
+// find (or create) archetype by mask
+size_t Archetypes::find(mask_t mask) {
+    auto it = byMask.find(mask);
+    if(it != byMask.end()) return it->second;
+    auto& sizes = columnSizes();
+    // lay out columns so that a chunk holds as many full rows as possible
+    size_t rowSize = sizeof(entity), nCols = 1;
+    for(size_t c = 0; c < maxColumns; ++c) {
+        if(mask & (mask_t(1) << c)) {
+            rowSize += sizes[c];
+            ++nCols;
+        }
+    }
+    Archetype a;
+    a.mask = mask;
+    a.capacity = (chunkBytes - 16*nCols) / rowSize;
+    size_t offset = a.capacity * sizeof(entity);
+    for(size_t c = 0; c < maxColumns; ++c) {
+        if(mask & (mask_t(1) << c)) {
+            offset = (offset + 15) & ~size_t(15);
+            a.offsets[c] = offset;
+            offset += a.capacity * sizes[c];
+        }
+    }
+    assert(offset <= chunkBytes);
+    archetypes.push_back(std::move(a));
+    byMask[mask] = archetypes.size() - 1;
+    return archetypes.size() - 1;
+}
+// archetype reached from a by adding / removing column col
+size_t Archetypes::toggle(size_t a, size_t col) {
+    auto it = archetypes[a].edges.find(col);
+    if(it != archetypes[a].edges.end()) return it->second;
+    // find may grow archetypes: don't hold a reference across it
+    size_t b = find(archetypes[a].mask ^ (mask_t(1) << col));
+    archetypes[a].edges[col] = b;
+    archetypes[b].edges[col] = a;
+    return b;
+}
+// move entity into archetype a (npos: out of archetype storage), returns new row
+size_t Archetypes::move(entity e, size_t a) {
+    uint32_t i = entityIndex(e);
+    if(i >= records.size()) records.resize(i+1);
+    Record from = records[i];
+    // a stale record of a recycled index is dropped, not carried over
+    if(from.owner != e) from.archetype = npos;
+    size_t row = npos;
+    if(a != npos) {
+        Archetype& dst = archetypes[a];
+        if(dst.size == dst.chunks.size()*dst.capacity) {
+            dst.chunks.push_back(std::make_unique<Chunk>());
+        }
+        row = dst.size++;
+        dst.entities(row/dst.capacity)[row%dst.capacity] = e;
+        // carry over the columns both archetypes share
+        if(from.archetype != npos) {
+            Archetype& src = archetypes[from.archetype];
+            auto& sizes = columnSizes();
+            mask_t shared = src.mask & dst.mask;
+            for(size_t c = 0; c < maxColumns; ++c) {
+                if(shared & (mask_t(1) << c)) {
+                    std::memcpy(dst.at(row,c,sizes[c]), src.at(from.row,c,sizes[c]), sizes[c]);
+                }
+            }
+        }
+    }
+    if(from.archetype != npos) erase(from.archetype, from.row);
+    records[i] = Record{ e, a, row };
+    return row;
+}
+// swap-remove row from archetype a
+void Archetypes::erase(size_t a, size_t row) {
+    Archetype& arc = archetypes[a];
+    size_t last = arc.size - 1;
+    if(row != last) {
+        auto& sizes = columnSizes();
+        for(size_t c = 0; c < maxColumns; ++c) {
+            if(arc.mask & (mask_t(1) << c)) {
+                std::memcpy(arc.at(row,c,sizes[c]), arc.at(last,c,sizes[c]), sizes[c]);
+            }
+        }
+        entity moved = arc.entities(last/arc.capacity)[last%arc.capacity];
+        arc.entities(row/arc.capacity)[row%arc.capacity] = moved;
+        records[entityIndex(moved)].row = row;
+    }
+    --arc.size;
+    // release the trailing chunk once it empties
+    if(arc.size == (arc.chunks.size()-1)*arc.capacity) {
+        arc.chunks.pop_back();
+    }
+}
@@ -0,0 +1,96 @@
+#include "atlas.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+
+AtlasPacker::AtlasPacker(int pageW, int pageH, int padding)
+    : pageW(pageW), pageH(pageH), padding(padding) {}
+
+bool AtlasPacker::place(Page& p, int w, int h, int& x, int& y) {
+    // best start segment: lowest resulting top, then leftmost
+    size_t best = p.skyline.size();
+    int bestY = std::numeric_limits<int>::max();
+    for(size_t i = 0; i < p.skyline.size(); ++i) {
+        int left = p.skyline[i].x;
+        if(left + w > p.w) break;
+        // rests on the highest segment under its span
+        int top = 0;
+        for(size_t k = i; k < p.skyline.size() && p.skyline[k].x < left + w; ++k) {
+            top = std::max(top, p.skyline[k].y);
+        }
+        if(top + h > p.h) continue;
+        if(top < bestY) {
+            bestY = top;
+            best = i;
+        }
+    }
+    if(best == p.skyline.size()) return false;
+    x = p.skyline[best].x;
+    y = bestY;
+    // raise the skyline under the new rect: cut the segments it covers
+    Segment raised{ x, y + h, w };
+    size_t k = best;
+    while(k < p.skyline.size() && p.skyline[k].x < x + w) {
+        Segment& s = p.skyline[k];
+        int right = s.x + s.w;
+        if(right <= x + w) {
+            p.skyline.erase(p.skyline.begin() + k);
+        }
+        else {
+            s.w = right - (x + w);
+            s.x = x + w;
+            break;
+        }
+    }
+    p.skyline.insert(p.skyline.begin() + best, raised);
+    // merge neighbours at the same height
+    for(size_t i = 1; i < p.skyline.size();) {
+        if(p.skyline[i-1].y == p.skyline[i].y) {
+            p.skyline[i-1].w += p.skyline[i].w;
+            p.skyline.erase(p.skyline.begin() + i);
+        }
+        else ++i;
+    }
+    return true;
+}
+std::vector<AtlasPacker::Placement> AtlasPacker::pack(const std::vector<std::pair<int,int>>& sizes) {
+    std::vector<Placement> out(sizes.size(), Placement{ 0, 0, 0 });
+    // tallest first, then widest
+    std::vector<size_t> order(sizes.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        if(sizes[a].second != sizes[b].second) return sizes[a].second > sizes[b].second;
+        return sizes[a].first > sizes[b].first;
+    });
+    for(size_t r : order) {
+        int w = sizes[r].first + padding, h = sizes[r].second + padding;
+        Placement& pl = out[r];
+        // too large for a page: a page of its own
+        if(w > pageW || h > pageH) {
+            pages.push_back(Page{ sizes[r].first, sizes[r].second, {} });
+            pl = Placement{ pages.size() - 1, 0, 0 };
+            continue;
+        }
+        bool placed = false;
+        for(size_t p = 0; p < pages.size() && !placed; ++p) {
+            if(!pages[p].skyline.empty()) {
+                placed = place(pages[p], w, h, pl.x, pl.y);
+                pl.page = p;
+            }
+        }
+        if(!placed) {
+            pages.push_back(Page{ pageW, pageH, { Segment{ 0, 0, pageW } } });
+            pl.page = pages.size() - 1;
+            place(pages.back(), w, h, pl.x, pl.y);
+        }
+    }
+    return out;
+}
+std::vector<std::pair<int,int>> AtlasPacker::pageSizes() const {
+    std::vector<std::pair<int,int>> out;
+    for(const Page& p : pages) {
+        out.emplace_back(p.w, p.h);
+    }
+    return out;
+}
@@ -0,0 +1,66 @@
+#include "broadphase.hpp"
+
+#include <algorithm>
+
+void SweepAndPrune::clear() {
+    for(uint32_t id : order) {
+        boxes[id].present = false;
+    }
+}
+void SweepAndPrune::insert(uint32_t id, const rectf& r, bool dynamic) {
+    if(id >= boxes.size()) boxes.resize(id+1);
+    Box& b = boxes[id];
+    b.r = r;
+    b.dynamic = dynamic;
+    b.present = true;
+    if(!b.listed) {
+        b.listed = true;
+        order.push_back(id);
+    }
+}
+void SweepAndPrune::candidates(std::vector<std::pair<uint32_t,uint32_t>>& out) {
+    out.clear();
+    // drop boxes that were not inserted this tick
+    size_t kept = 0, keptSorted = 0;
+    for(size_t k = 0; k < order.size(); ++k) {
+        uint32_t id = order[k];
+        if(!boxes[id].present) {
+            boxes[id].listed = false;
+            continue;
+        }
+        if(k < sorted) ++keptSorted;
+        order[kept++] = id;
+    }
+    order.resize(kept);
+    // last tick's boxes moved a little: insertion sort
+    for(size_t k = 1; k < keptSorted; ++k) {
+        uint32_t id = order[k];
+        size_t m = k;
+        for(; m > 0 && less(id, order[m-1]); --m) {
+            order[m] = order[m-1];
+        }
+        order[m] = id;
+    }
+    // new boxes are in no particular order: sort them apart, then merge in
+    auto byX = [this](uint32_t a, uint32_t b) { return less(a, b); };
+    std::sort(order.begin() + keptSorted, order.end(), byX);
+    std::inplace_merge(order.begin(), order.begin() + keptSorted, order.end(), byX);
+    sorted = order.size();
+    widest = 0.f;
+    for(uint32_t id : order) {
+        widest = std::max(widest, boxes[id].r.w);
+    }
+    // sweep: each box against those starting before its right edge
+    for(size_t a = 0; a < order.size(); ++a) {
+        const Box& b1 = boxes[order[a]];
+        float right = b1.r.x + b1.r.w;
+        for(size_t b = a+1; b < order.size() && boxes[order[b]].r.x < right; ++b) {
+            const Box& b2 = boxes[order[b]];
+            if(!b1.dynamic && !b2.dynamic) continue;
+            if(b1.r.y < b2.r.y + b2.r.h && b1.r.y + b1.r.h > b2.r.y) {
+                out.emplace_back(std::min(order[a], order[b]), std::max(order[a], order[b]));
+            }
+        }
+    }
+    std::sort(out.begin(), out.end());
+}
@@ -0,0 +1,18 @@
+#include "command.hpp"
+
+// apply recorded changes to the context, and reset
+void CommandBuffer::apply(Context& c) {
+    spawned.clear();
+    spawned.reserve(pendingCount);
+    for(uint32_t i = 0; i < pendingCount; ++i) {
+        spawned.push_back(c.addEntity());
+    }
+    for(auto& b : addBatches) b->execute(c, spawned);
+    for(auto& b : removeBatches) b->execute(c, spawned);
+    for(entity e : destroys) {
+        c.removeEntity(resolvePending(spawned, e));
+    }
+    pendingCount = 0;
+    destroys.clear();
+    // batches are emptied by execute, keep them (and their storage) for reuse
+}
@@ -2,18 +2,75 @@
 
 #include <type_traits>
 
-// create new entity
+// create new entity, recycling a freed index if there is one
 entity Context::addEntity() {
-    static entity created = 0;
-    entity id = ++created;
+    uint32_t index;
+    if(!freed.empty()) {
+        index = freed.back();
+        freed.pop_back();
+    }
+    else {
+        index = uint32_t(generations.size());
+        generations.push_back(0);
+        signatures.emplace_back();
+    }
+    entity id = makeEntity(index, generations[index]);
     entities.insert(id);
+    fresh.push_back(id);
     return id;
 }
 unordered_set<entity> Context::getEntities() { return entities; }
-// add component to entity
-// entity has components?
-// needs to be last to know template specializations
+bool Context::alive(entity e) const {
+    uint32_t i = entityIndex(e);
+    return i != 0 && i < generations.size() && generations[i] == entityGeneration(e);
+}
+// remove entity & all of its components, retire its handle
 void Context::removeEntity(entity e) {
+    if(!alive(e)) return;
+    uint32_t i = entityIndex(e);
+    // only visit the pools the signature says hold a component
+    signature& s = signatures[i];
+    for(size_t id = 0; id < pools.size(); ++id) {
+        if(s[id] && pools[id]) pools[id]->remove(e);
+    }
+    bodies.clear(e);
+    s.reset();
     entities.erase(e);
-    // figure out later
-}
\ No newline at end of file
+    ++generations[i];
+    freed.push_back(i);
+}
+void Context::beginIndex() {
+    spatial.clear();
+    ++pass;
+    boxing.clear();
+}
+void Context::endIndex(std::vector<std::pair<uint32_t,uint32_t>>& candidates) {
+    spatial.candidates(candidates);
+    // left without a box: still loose, added since, or boxed last pass but not this one
+    std::vector<entity> left;
+    auto keep = [&](entity e) {
+        if(alive(e) && !boxedThisPass(e)) left.push_back(e);
+    };
+    for(entity e : loose) keep(e);
+    for(entity e : fresh) keep(e);
+    for(entity e : boxed) keep(e);
+    loose.swap(left);
+    fresh.clear();
+    boxed.swap(boxing);
+}
+std::vector<entity> Context::queryBox(const rectf& r) {
+    std::vector<entity> es;
+    spatial.query(r, [&](uint32_t id) {
+        entity e = indexed(id);
+        if(e != nullEntity) es.push_back(e);
+    });
+    return es;
+}
+std::vector<entity> Context::queryCircle(vec2f center, float radius) {
+    std::vector<entity> es;
+    spatial.query(rectf(center.x - radius, center.y - radius, 2.f*radius, 2.f*radius), [&](uint32_t id) {
+        entity e = indexed(id);
+        if(e != nullEntity && distance(center, spatial.box(id)) <= radius) es.push_back(e);
+    });
+    return es;
+}
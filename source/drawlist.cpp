@@ -0,0 +1,83 @@
+#include "drawlist.hpp"
+
+#include <cstring>
+
+void DrawList::clear() {
+    ++frame;
+    added.clear();
+}
+void DrawList::add(uint32_t id, float depth, const LRenderable& r) {
+    if(id >= slots.size()) slots.resize(id+1, {0, 0});
+    slots[id] = { frame, uint32_t(added.size()) };
+    added.push_back({ makeKey(depth, textureId(r.texPtr)), id, r });
+}
+void DrawList::sort() {
+    // last frame's draws added again keep their place (with this frame's data)
+    size_t kept = 0;
+    for(size_t k = 0; k < items.size(); ++k) {
+        auto& s = slots[items[k].id];
+        if(s.first != frame) continue;
+        items[kept++] = added[s.second];
+        // placed
+        s.first = 0;
+    }
+    items.erase(items.begin() + kept, items.end());
+    for(const Item& it : added) {
+        if(slots[it.id].first == frame) items.push_back(it);
+    }
+    size_t disorder = 0;
+    for(size_t k = 1; k < items.size(); ++k) {
+        if(items[k].key < items[k-1].key) ++disorder;
+    }
+    incremental = float(disorder) <= nearlySorted*float(items.size());
+    if(incremental) insertionSort();
+    else radixSort();
+}
+void DrawList::insertionSort() {
+    for(size_t k = 1; k < items.size(); ++k) {
+        if(!(items[k].key < items[k-1].key)) continue;
+        Item it = items[k];
+        size_t m = k;
+        for(; m > 0 && it.key < items[m-1].key; --m) {
+            items[m] = items[m-1];
+        }
+        items[m] = it;
+    }
+}
+void DrawList::radixSort() {
+    if(items.empty()) return;
+    scratch.assign(items.begin(), items.end());
+    // a byte per pass, least significant first (stable)
+    for(unsigned shift = 0; shift < 64; shift += 8) {
+        size_t count[256] = {};
+        for(const Item& it : items) {
+            ++count[(it.key >> shift) & 0xff];
+        }
+        // every key shares this byte (e.g. high bytes of texture ids)
+        if(count[(items[0].key >> shift) & 0xff] == items.size()) continue;
+        size_t sum = 0;
+        for(size_t& n : count) {
+            size_t c = n;
+            n = sum;
+            sum += c;
+        }
+        for(const Item& it : items) {
+            scratch[count[(it.key >> shift) & 0xff]++] = it;
+        }
+        items.swap(scratch);
+    }
+}
+uint32_t DrawList::textureId(SDL_Texture* tex) {
+    auto it = textures.find(tex);
+    if(it != textures.end()) return it->second;
+    uint32_t id = uint32_t(textures.size());
+    textures.emplace(tex, id);
+    return id;
+}
+uint64_t DrawList::makeKey(float depth, uint32_t texture) {
+    uint32_t bits;
+    std::memcpy(&bits, &depth, sizeof bits);
+    // order preserving: negatives flipped below the positives
+    bits = (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u);
+    return (uint64_t(bits) << 32) | texture;
+}
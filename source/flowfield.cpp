@@ -0,0 +1,86 @@
+#include "flowfield.hpp"
+
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <utility>
+
+namespace {
+    // neighbour offsets: orthogonal first, then diagonal
+    const int dx[8] = { 1, -1, 0, 0, 1, 1, -1, -1 };
+    const int dy[8] = { 0, 0, 1, -1, 1, -1, 1, -1 };
+}
+
+int FlowField::cellX(float x) const {
+    return int(std::floor(x/grid->cellWidth()));
+}
+int FlowField::cellY(float y) const {
+    return int(std::floor(y/grid->cellHeight()));
+}
+float FlowField::at(int x, int y) const {
+    if(x < 0 || y < 0 || x >= int(grid->columns()) || y >= int(grid->rows())) {
+        return std::numeric_limits<float>::infinity();
+    }
+    return cost[size_t(y)*grid->columns() + x];
+}
+bool FlowField::build(const TileGrid& g, vec2f target) {
+    bool sameGrid = (grid == &g);
+    grid = &g;
+    int gx = cellX(target.x), gy = cellY(target.y);
+    if(sameGrid && gx == goalX && gy == goalY) return false;
+    goalX = gx;
+    goalY = gy;
+    unsigned w = g.columns(), h = g.rows();
+    cost.assign(size_t(w)*h, std::numeric_limits<float>::infinity());
+    // goal off the map: nothing reaches it
+    if(gx < 0 || gy < 0 || gx >= int(w) || gy >= int(h)) return true;
+    // dijkstra from the goal (the goal cell itself counts as free, the target stands in it)
+    using node = std::pair<float,size_t>;
+    std::priority_queue<node, std::vector<node>, std::greater<node>> open;
+    size_t start = size_t(gy)*w + gx;
+    cost[start] = 0.f;
+    open.emplace(0.f, start);
+    const float diagonal = std::sqrt(2.f);
+    while(!open.empty()) {
+        auto [d, k] = open.top(); open.pop();
+        if(d > cost[k]) continue;
+        int x = int(k % w), y = int(k / w);
+        for(int n = 0; n < 8; ++n) {
+            int nx = x + dx[n], ny = y + dy[n];
+            if(g.blocked(nx, ny)) continue;
+            // no corner cutting
+            if(n >= 4 && (g.blocked(x + dx[n], y) || g.blocked(x, y + dy[n]))) continue;
+            float nd = d + (n < 4 ? 1.f : diagonal);
+            size_t nk = size_t(ny)*w + nx;
+            if(nd < cost[nk]) {
+                cost[nk] = nd;
+                open.emplace(nd, nk);
+            }
+        }
+    }
+    return true;
+}
+vec2f FlowField::direction(vec2f p) const {
+    if(grid == nullptr) return vec2f(0.f,0.f);
+    int x = cellX(p.x), y = cellY(p.y);
+    if(x == goalX && y == goalY) return vec2f(0.f,0.f);
+    // steepest descent among the neighbours reachable from here
+    float best = at(x, y);
+    int bx = x, by = y;
+    for(int n = 0; n < 8; ++n) {
+        int nx = x + dx[n], ny = y + dy[n];
+        if(n >= 4 && (grid->blocked(x + dx[n], y) || grid->blocked(x, y + dy[n]))) continue;
+        float c = at(nx, ny);
+        if(c < best) {
+            best = c;
+            bx = nx;
+            by = ny;
+        }
+    }
+    if(bx == x && by == y) return vec2f(0.f,0.f);
+    // head for the centre of that cell
+    vec2f to((bx + 0.5f)*grid->cellWidth() - p.x, (by + 0.5f)*grid->cellHeight() - p.y);
+    float len = std::sqrt(to.x*to.x + to.y*to.y);
+    return (len > 0.f) ? vec2f(to.x/len, to.y/len) : vec2f(0.f,0.f);
+}
@@ -0,0 +1,79 @@
+#include "integrate.hpp"
+
+#include <emmintrin.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+void accelerateScalar(size_t n, float* v, float* a, const float* f, const float* m, float dt) {
+    for(size_t i = 0; i < n; ++i) {
+        for(size_t k = 2*i; k < 2*i + 2; ++k) {
+            a[k] = f[k] / m[i];
+            v[k] += a[k] * dt;
+        }
+    }
+}
+void advanceScalar(size_t n, float* p, const float* v, float dt) {
+    for(size_t k = 0; k < 2*n; ++k) {
+        p[k] += v[k] * dt;
+    }
+}
+// unaligned loads / stores throughout: columns are only guaranteed 16-byte aligned
+void accelerate(size_t n, float* v, float* a, const float* f, const float* m, float dt) {
+    size_t i = 0;
+#ifdef __AVX2__
+    // 8 bodies (16 floats) per step
+    const __m256 dt8 = _mm256_set1_ps(dt);
+    for(; i + 8 <= n; i += 8) {
+        // widen masses to x/y pairs: (m0,m0,m1,m1,m2,m2,m3,m3), (m4,m4,...,m7,m7)
+        __m256 ms = _mm256_loadu_ps(m + i);
+        __m256 lo = _mm256_unpacklo_ps(ms, ms);
+        __m256 hi = _mm256_unpackhi_ps(ms, ms);
+        __m256 m0 = _mm256_permute2f128_ps(lo, hi, 0x20);
+        __m256 m1 = _mm256_permute2f128_ps(lo, hi, 0x31);
+        size_t k = 2*i;
+        __m256 a0 = _mm256_div_ps(_mm256_loadu_ps(f + k), m0);
+        __m256 a1 = _mm256_div_ps(_mm256_loadu_ps(f + k + 8), m1);
+        __m256 v0 = _mm256_add_ps(_mm256_loadu_ps(v + k), _mm256_mul_ps(a0, dt8));
+        __m256 v1 = _mm256_add_ps(_mm256_loadu_ps(v + k + 8), _mm256_mul_ps(a1, dt8));
+        _mm256_storeu_ps(a + k, a0); _mm256_storeu_ps(a + k + 8, a1);
+        _mm256_storeu_ps(v + k, v0); _mm256_storeu_ps(v + k + 8, v1);
+    }
+#endif
+    // 4 bodies (8 floats) per step
+    const __m128 dt4 = _mm_set1_ps(dt);
+    for(; i + 4 <= n; i += 4) {
+        // widen masses to x/y pairs: (m0,m0,m1,m1), (m2,m2,m3,m3)
+        __m128 ms = _mm_loadu_ps(m + i);
+        __m128 m0 = _mm_unpacklo_ps(ms, ms);
+        __m128 m1 = _mm_unpackhi_ps(ms, ms);
+        size_t k = 2*i;
+        __m128 a0 = _mm_div_ps(_mm_loadu_ps(f + k), m0);
+        __m128 a1 = _mm_div_ps(_mm_loadu_ps(f + k + 4), m1);
+        __m128 v0 = _mm_add_ps(_mm_loadu_ps(v + k), _mm_mul_ps(a0, dt4));
+        __m128 v1 = _mm_add_ps(_mm_loadu_ps(v + k + 4), _mm_mul_ps(a1, dt4));
+        _mm_storeu_ps(a + k, a0); _mm_storeu_ps(a + k + 4, a1);
+        _mm_storeu_ps(v + k, v0); _mm_storeu_ps(v + k + 4, v1);
+    }
+    // remainder
+    accelerateScalar(n - i, v + 2*i, a + 2*i, f + 2*i, m + i, dt);
+}
+void advance(size_t n, float* p, const float* v, float dt) {
+    size_t k = 0;
+#ifdef __AVX2__
+    // 4 bodies (8 floats) per step
+    const __m256 dt8 = _mm256_set1_ps(dt);
+    for(; k + 8 <= 2*n; k += 8) {
+        __m256 p0 = _mm256_add_ps(_mm256_loadu_ps(p + k), _mm256_mul_ps(_mm256_loadu_ps(v + k), dt8));
+        _mm256_storeu_ps(p + k, p0);
+    }
+#endif
+    // 2 bodies (4 floats) per step
+    const __m128 dt4 = _mm_set1_ps(dt);
+    for(; k + 4 <= 2*n; k += 4) {
+        __m128 p0 = _mm_add_ps(_mm_loadu_ps(p + k), _mm_mul_ps(_mm_loadu_ps(v + k), dt4));
+        _mm_storeu_ps(p + k, p0);
+    }
+    // remainder
+    advanceScalar(n - k/2, p + k, v + k, dt);
+}
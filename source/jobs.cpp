@@ -0,0 +1,97 @@
+#include "jobs.hpp"
+
+namespace {
+    // pool & queue index of the current worker thread
+    thread_local const ThreadPool* currentPool = nullptr;
+    thread_local size_t currentQueue = 0;
+}
+
+unsigned ThreadPool::defaultWorkers() {
+    unsigned cores = std::thread::hardware_concurrency();
+    return (cores > 1) ? cores - 1 : 0;
+}
+ThreadPool::ThreadPool(unsigned numWorkers) {
+    for(unsigned i = 0; i <= numWorkers; ++i) {
+        queues.push_back(std::make_unique<Queue>());
+    }
+    for(unsigned i = 0; i < numWorkers; ++i) {
+        workers.emplace_back([this, i] { work(i); });
+    }
+}
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for(std::thread& t : workers) t.join();
+}
+size_t ThreadPool::home() const {
+    return (currentPool == this) ? currentQueue : queues.size() - 1;
+}
+bool ThreadPool::take(size_t self, std::function<void()>& job) {
+    {
+        Queue& q = *queues[self];
+        std::lock_guard<std::mutex> lock(q.m);
+        if(!q.jobs.empty()) {
+            job = std::move(q.jobs.back());
+            q.jobs.pop_back();
+            --queued;
+            return true;
+        }
+    }
+    for(size_t k = 1; k < queues.size(); ++k) {
+        Queue& q = *queues[(self + k) % queues.size()];
+        std::lock_guard<std::mutex> lock(q.m);
+        if(!q.jobs.empty()) {
+            job = std::move(q.jobs.front());
+            q.jobs.pop_front();
+            --queued;
+            return true;
+        }
+    }
+    return false;
+}
+void ThreadPool::work(size_t self) {
+    currentPool = this;
+    currentQueue = self;
+    std::function<void()> job;
+    while(true) {
+        if(take(self, job)) {
+            job();
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wake.wait(lock, [this] { return stopping || queued > 0; });
+        if(stopping) return;
+    }
+}
+// run every job, returning once all have finished (the caller helps out)
+void ThreadPool::run(std::vector<std::function<void()>>& jobs) {
+    if(jobs.empty()) return;
+    if(workers.empty() || jobs.size() == 1) {
+        for(auto& job : jobs) job();
+        return;
+    }
+    size_t self = home();
+    std::atomic<size_t> remaining{ jobs.size() };
+    {
+        // counted before they are published, so a taker never drops it below zero
+        std::lock_guard<std::mutex> sleep(sleepMutex);
+        Queue& q = *queues[self];
+        std::lock_guard<std::mutex> lock(q.m);
+        queued += jobs.size();
+        for(auto& job : jobs) {
+            q.jobs.emplace_back([&job, &remaining] {
+                job();
+                --remaining;
+            });
+        }
+    }
+    wake.notify_all();
+    std::function<void()> job;
+    while(remaining > 0) {
+        if(take(self, job)) job();
+        else std::this_thread::yield();
+    }
+}
@@ -1,6 +1,7 @@
 #include "loader.hpp"
 #include "utility.hpp"
 #include "logger.hpp"
+#include "atlas.hpp"
 
 // SDL_Image
 #include <SDL.h>
@@ -11,8 +12,8 @@
 #include <iterator>
 #include <algorithm>
 #include <streambuf>
-#include <bitset>
 #include <map>
+#include <cmath>
 
 // auxillary objects / functions
 extern Logger glog; // gamelog - instantiated in main.cpp
@@ -27,6 +28,48 @@ Loader::Loader(const std::string& resourceDirectory) {
     tmx::setLoggingStream(glog.get());
 }
 
+// merge touching / overlapping boxes into maximal rectangles, without changing
+// the covered area: first runs along rows (same y & height), then stacks of
+// those runs (same x & width)
+std::vector<rectf> Loader::mergeBoxes(std::vector<rectf> boxes) {
+    const float eps = 1e-3f;
+    // y & height snapped to steps of eps: compared exactly, so the sort has a strict
+    // weak order, and boxes on the same steps share a row
+    auto step = [eps](float v) { return std::llround(v / eps); };
+    // merge runs along x of boxes sharing y & height
+    auto runs = [&]() {
+        std::sort(boxes.begin(), boxes.end(), [&](const rectf& a, const rectf& b) {
+            if(step(a.y) != step(b.y)) return step(a.y) < step(b.y);
+            if(step(a.h) != step(b.h)) return step(a.h) < step(b.h);
+            return a.x < b.x;
+        });
+        std::vector<rectf> merged;
+        for(const rectf& r : boxes) {
+            if(!merged.empty()) {
+                rectf& m = merged.back();
+                if(step(m.y) == step(r.y) && step(m.h) == step(r.h) && r.x <= m.x + m.w + eps) {
+                    m.w = std::max(m.x + m.w, r.x + r.w) - m.x;
+                    continue;
+                }
+            }
+            merged.push_back(r);
+        }
+        boxes.swap(merged);
+    };
+    auto transpose = [&]() {
+        for(rectf& r : boxes) {
+            std::swap(r.x, r.y);
+            std::swap(r.w, r.h);
+        }
+    };
+    // row runs, then vertical merging of the runs (as runs of the transpose)
+    runs();
+    transpose();
+    runs();
+    transpose();
+    return boxes;
+}
+
 // populate tilemaps & entity metas
 void Loader::loadTilemap(const std::string& filename, const std::string& mapname) {
     assert(tilemapMetas.count(mapname) == 0);
@@ -62,26 +105,23 @@ tilesetMetaPtr Loader::loadTileset(tmx::tileset ts, SDL_Renderer* renderer)
     for(tmx::tile t : ts.tiles) {
         tmPtr->tileMetas[t.id] = loadTile(t);
     }
-    // get image source information, create textures with renderer
+    // get image source information, its texture is an atlas page (see packAtlas)
     std::string path = resDir + "//" + ts.img.source;
     SDL_Surface* img = IMG_Load(path.c_str());
     if(img != nullptr) {
         glog.get() << "[loader]: source image '" << path << "' loaded successfully!\n";
+        unpacked.emplace_back(tmPtr, img);
     }
     else {
         glog.get() << "[loader]: source image '" << path << "' load failed!\n";
     }
     glog.get().flush();
-    SDL_Texture* tex = SDL_CreateTextureFromSurface(renderer,img);
-    if(tex == nullptr) {
-        glog.get() << "[loader]: texture creation from loaded image failed!\n";
-    }
     glog.get() << "[loader]: tileset " << ts.name << " loaded, tile dims = "
               << ts.tilewidth << " x " << ts.tileheight << "\n";
     glog.get() << "[loader]: image " << ts.img.source << " loaded, dims = "
               << ts.img.width << " x " << ts.img.height << "\n";
     glog.get().flush();
-    tmPtr->tex = tex;
+    tmPtr->tex = nullptr;
     tmPtr->numCols = ts.columns;
     tmPtr->numRows = ts.tilecount/ts.columns;
     tmPtr->tilewidth = ts.tilewidth;
@@ -89,6 +129,59 @@ tilesetMetaPtr Loader::loadTileset(tmx::tileset ts, SDL_Renderer* renderer)
     return tmPtr;
 }
 
+// pack queued tileset images into new atlas pages, point their tilesets there
+void Loader::packAtlas(SDL_Renderer* renderer) {
+    if(unpacked.empty()) return;
+    int edge = atlasPageSize;
+    SDL_RendererInfo info;
+    if(SDL_GetRendererInfo(renderer, &info) == 0 && info.max_texture_width > 0 && info.max_texture_height > 0) {
+        edge = std::min({ edge, info.max_texture_width, info.max_texture_height });
+    }
+    std::vector<std::pair<int,int>> sizes;
+    for(auto& [ts, img] : unpacked) {
+        sizes.emplace_back(img->w, img->h);
+    }
+    AtlasPacker packer(edge, edge);
+    std::vector<AtlasPacker::Placement> placed = packer.pack(sizes);
+    // compose pages in memory, each uploaded once
+    std::vector<SDL_Surface*> pages;
+    for(auto [w, h] : packer.pageSizes()) {
+        pages.push_back(SDL_CreateRGBSurfaceWithFormat(0, w, h, 32, SDL_PIXELFORMAT_RGBA32));
+    }
+    for(size_t k = 0; k < unpacked.size(); ++k) {
+        auto& [ts, img] = unpacked[k];
+        SDL_Surface* page = pages[placed[k].page];
+        if(page != nullptr) {
+            SDL_Rect dst = { placed[k].x, placed[k].y, img->w, img->h };
+            // copy pixels as they are, alpha included
+            SDL_SetSurfaceBlendMode(img, SDL_BLENDMODE_NONE);
+            SDL_BlitSurface(img, nullptr, page, &dst);
+        }
+        SDL_FreeSurface(img);
+        ts->x = placed[k].x;
+        ts->y = placed[k].y;
+    }
+    size_t first = atlasPages.size();
+    for(SDL_Surface* page : pages) {
+        SDL_Texture* tex = SDL_CreateTextureFromSurface(renderer, page);
+        if(tex == nullptr) {
+            glog.get() << "[loader]: atlas page texture creation failed!\n";
+        }
+        else {
+            SDL_SetTextureBlendMode(tex, SDL_BLENDMODE_BLEND);
+        }
+        atlasPages.push_back(tex);
+        SDL_FreeSurface(page);
+    }
+    for(size_t k = 0; k < unpacked.size(); ++k) {
+        unpacked[k].first->tex = atlasPages[first + placed[k].page];
+    }
+    glog.get() << "[loader]: packed " << unpacked.size() << " tileset images into "
+               << pages.size() << " atlas page(s) of " << edge << " x " << edge << "\n";
+    glog.get().flush();
+    unpacked.clear();
+}
+
 // create textures based on tilemap & entity metas (using the passed renderer)
 // NOTE: this is a fucking mess of a function
 void Loader::populateTilemap(const std::string& mapname, SDL_Renderer* renderer) {
@@ -107,8 +200,29 @@ void Loader::populateTilemap(const std::string& mapname, SDL_Renderer* renderer)
         glog.get() << "\t-> loaded tileset: '" << ts.name << "'\n";
         glog.get().flush();
     }
-    // make tilemap image from layers & texture pointers
-    // get tile's gid -> SDL_Texture & source rect
+    // sprite sheets named by objects (sprite / shoots / cursorsprite properties)
+    std::unordered_map<std::string,tilesetMetaPtr> sheets;
+    for(tmx::objectgroup& group : tm.objectgroups) {
+        for(tmx::object& obj : group.objects) {
+            for(tmx::property& prop : obj.properties) {
+                if(prop.name != "sprite" && prop.name != "shoots" && prop.name != "cursorsprite") continue;
+                if(sheets.count(prop.value) != 0) continue;
+                tmx::tileset ts = tmx::loadTileset(prop.value);
+                if(tilesetMetas.count(ts.name) != 0) {
+                    sheets[prop.value] = tilesetMetas[ts.name];
+                }
+                else {
+                    sheets[prop.value] = loadTileset(ts,renderer);
+                }
+            }
+        }
+    }
+    for(auto& [sheetname, pTS] : sheets) {
+        tmMeta->spriteExtent = std::max({ tmMeta->spriteExtent, pTS->tilewidth, pTS->tileheight });
+    }
+    // every image in a few atlas pages, before anything draws from them
+    packAtlas(renderer);
+    // get tile's gid -> tileset index & local id
     auto getSetAndId = [&](unsigned gid) -> std::pair<unsigned,unsigned> {
         unsigned set = 1;
         for(; set < tm.tilesets.size(); ++set) {
@@ -117,114 +231,55 @@ void Loader::populateTilemap(const std::string& mapname, SDL_Renderer* renderer)
         --set;
         return {set, gid - tm.tilesets.at(set).firstgid};
     };
-    using TilePtr = std::pair<SDL_Texture*,SDL_Rect>;
-    auto getTilePtr = [&](unsigned gid) -> TilePtr {
-        auto [set, id] = getSetAndId(gid);
-        unsigned i = id / tm.tilesets.at(set).columns;
-        unsigned j = id % tm.tilesets.at(set).columns;
-        SDL_Texture* tex = tilesetMetas.at(tm.tilesets.at(set).name)->tex;
-        SDL_Rect r = tilesetMetas.at(tm.tilesets.at(set).name)->get(i,j);
-        return TilePtr{tex,r};
+    // tile's gid -> texture & source rect (tilesets held by the chunks that draw them)
+    std::vector<std::pair<unsigned,tilesetMetaPtr>> sets;
+    std::vector<unsigned> firstgids;
+    for(tmx::tileset& ts : tm.tilesets) {
+        sets.emplace_back(ts.columns, tilesetMetas.at(ts.name));
+        firstgids.push_back(ts.firstgid);
+    }
+    auto getTilePtr = [firstgids, sets](unsigned gid) -> std::pair<SDL_Texture*,SDL_Rect> {
+        size_t set = std::upper_bound(firstgids.begin() + 1, firstgids.end(), gid) - firstgids.begin() - 1;
+        unsigned id = gid - firstgids.at(set);
+        auto& [columns, pTS] = sets.at(set);
+        return { pTS->tex, pTS->get(id / columns, id % columns) };
     };
-    // create a texture for rendering into & tilemap collision entities
+    // split layers into chunks & collect the static collision boxes
     unsigned mw = tm.width*tm.tilewidth, mh = tm.height*tm.tileheight;
-    for(tmx::layer l : tm.layers) {
-        glog.get() << "[loader]: instantiating a render target texture for layer '" << l.name << "' of size " << mw << "x" << mh << "\n";
+    auto grid = std::make_shared<TileGrid>(tm.width, tm.height, tm.tilewidth, tm.tileheight);
+    std::vector<rectf> staticBoxes;
+    for(tmx::layer& l : tm.layers) {
+        auto chunks = std::make_shared<TileChunks>(l.data, tm.tilewidth, tm.tileheight, getTilePtr, chunkSize);
+        glog.get() << "[loader]: layer '" << l.name << "' of size " << mw << "x" << mh
+                   << " split into chunks of up to " << chunkSize << "x" << chunkSize << "\n";
         glog.get().flush();
-        SDL_Texture* layerTexture = SDL_CreateTexture(renderer,SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, mw, mh);
-        SDL_SetTextureBlendMode(layerTexture, SDL_BLENDMODE_BLEND);
-        SDL_SetRenderTarget(renderer, layerTexture);
         for(unsigned i = 0; i < l.data.size(); ++i) {
-            for(unsigned j = 0; j < l.data[0].size(); ++j) {
-                unsigned gid = l.data.at(i).at(j); 
-                // unsigned highest bits
-                std::bitset<32> b(gid);
-                // store transforms
-                bool flipH = b[31], flipV = b[30], flipD = b[29];
-                b[31] = false; b[30] = false; b[29] = false;
-                gid = b.to_ulong();
-                auto [tex, sourceRect] = getTilePtr(gid);
-                // render tile into a smaller texture temporarilly for transfomation processing (3-pass flipping)
-                SDL_RendererFlip flip1 = SDL_FLIP_NONE;
-                SDL_RendererFlip flip2 = SDL_FLIP_NONE;
-                SDL_RendererFlip flip3 = SDL_FLIP_NONE;
-                SDL_Texture* tileTexture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, sourceRect.w, sourceRect.h);
-                SDL_SetTextureBlendMode(tileTexture, SDL_BLENDMODE_BLEND);
-                SDL_SetRenderTarget(renderer, tileTexture);
-                double angle1 = 0.0;
-                SDL_Point p1;
-                p1.x = 0; p1.y = 0;
-                if(flipD) {
-                    flip1 = SDL_FLIP_HORIZONTAL;
-                    angle1 = 270.0;
-                    p1.x = sourceRect.w/2;
-                    p1.y = sourceRect.h/2;
-                    //log.get() << "[loader]: flipping diagonally\n";
-                }
-                // first pass: flip diagonally
-                SDL_Rect source1;
-                source1.x = sourceRect.x; source1.y = sourceRect.y;
-                source1.w = sourceRect.w; source1.h = sourceRect.h;
-                SDL_Rect dest1;
-                dest1.x = 0; dest1.y = 0;
-                dest1.w = sourceRect.w; dest1.h = sourceRect.h;
-                SDL_RenderCopyEx(renderer, tex, &source1, &dest1, angle1, &p1, flip1);
-                // second pass: flip horizontally
-                if(flipH) {
-                    flip2 = SDL_FLIP_HORIZONTAL;
-                    //log.get() << "[loader]: flipping horizontally\n";
-                }
-                SDL_Rect source2;
-                source2.x = 0; source2.y = 0;
-                source2.w = sourceRect.w; source2.h = sourceRect.h;
-                SDL_Rect dest2;
-                dest2.x = 0; dest2.y = 0;
-                dest2.w = sourceRect.w; dest2.h = sourceRect.h;
-                SDL_Point p2;
-                p2.x = 0; p2.y = 0;
-                SDL_RenderCopyEx(renderer, tileTexture, &source2, &dest2, 0.0, &p2, flip2);
-                SDL_SetRenderTarget(renderer, layerTexture);
-                // third pass: flip vertically
-                if(flipV) {
-                    flip3 = SDL_FLIP_VERTICAL;
-                    //log.get() << "[loader]: flipping vertically\n";
-                }
-                SDL_Rect source3;
-                source3.x = 0; source3.y = 0;
-                source3.w = sourceRect.w; source3.h = sourceRect.h;
-                SDL_Rect dest3;
-                dest3.x = j*tm.tilewidth; dest3.y = i*tm.tileheight; 
-                dest3.w = source2.w; dest3.h = source2.h;
-                SDL_Point p3;
-                p3.x = 0; p3.y = 0;
-                SDL_RenderCopyEx(renderer, tileTexture, &source3, &dest3, 0.0, &p3, flip3);
-                SDL_DestroyTexture(tileTexture);
-                // collision boxes?
+            for(unsigned j = 0; j < l.data[i].size(); ++j) {
+                // without the flip bits
+                unsigned gid = l.data[i][j] & 0x1fffffffu;
+                if(gid == 0) continue;
                 auto [set, id] = getSetAndId(gid);
                 if(tilesetMetas[tm.tilesets[set].name]->tileMetas.count(id) != 0) {
                     for(rectf& box : tilesetMetas[tm.tilesets[set].name]->tileMetas[id]->boxes) {
-                        entity e = cxt->addEntity();
-                        float x = j*tm.tilewidth + box.x;
-                        float y = i*tm.tileheight + box.y;
-                        cxt->addComponent<position>(e,x,y);
-                        cxt->addComponent<volume>(e,box);
-                        glog.get() << "added a environment collision at (" << x << "," << y << ")\n";
-                        glog.get().flush();
+                        staticBoxes.emplace_back(j*tm.tilewidth + box.x, i*tm.tileheight + box.y, box.w, box.h);
                     }
                 }
-                //log.get() << "\n";
             }
         }
-        glog.get() << "\t done w/ layer render!\n"; glog.get().flush();
-        // push finished layer texture
-        tmMeta->layers.push_back(layerTexture);
-        // retarget default
-        SDL_SetRenderTarget(renderer,nullptr);
+        tmMeta->layers.push_back(chunks);
     }
+    // tile collision boxes live in one grid on a single terrain entity
+    size_t tileBoxes = staticBoxes.size();
+    if(mergeCollision) staticBoxes = mergeBoxes(std::move(staticBoxes));
+    for(const rectf& box : staticBoxes) grid->add(box);
+    grid->build();
+    entity world = cxt->addEntity();
+    cxt->addComponent<terrain>(world, grid);
+    glog.get() << "[loader]: built static collision grid with " << grid->getBoxes().size()
+               << " boxes (" << tileBoxes << " tile boxes, merging " << (mergeCollision ? "on" : "off") << ")\n";
     // load objectgroups into entities
     glog.get() << "\n[loader]: loading objectgroups into entities\n";
     glog.get().flush();
-    std::unordered_map<std::string,tilesetMetaPtr> spriteMetas;
     // do first pass to catch all possible references between objects
     std::vector<std::vector<entity>> es;
     std::map<unsigned,entity> eids;
@@ -247,7 +302,7 @@ void Loader::populateTilemap(const std::string& mapname, SDL_Renderer* renderer)
             glog.get() << "[loader]: adding entity w/ name = " << obj.name << "...\n";
             // camera
             if(obj.type == "camera") {
-                entity target = 0;
+                entity target = nullEntity;
                 float zoom = 1.0f;
                 for(tmx::property& prop : obj.properties) {
                     if(prop.name == "target") {
@@ -289,29 +344,13 @@ void Loader::populateTilemap(const std::string& mapname, SDL_Renderer* renderer)
                     std::string sheetname = prop.value;
                     glog.get() << "\t[loader]: read 'sprite' property: need sheetname:'" << sheetname << "'\n";
                     glog.get().flush();
-                    tmx::tileset ts = tmx::loadTileset(sheetname);
-                    // TODO: don't load more than you need to
-                    if(tilesetMetas.count(ts.name) != 0) {
-                        spriteMetas[ts.name] = tilesetMetas[ts.name];
-                    }
-                    else if(spriteMetas.count(ts.name) == 0) {
-                        spriteMetas[ts.name] = loadTileset(ts,renderer);
-                    }
-                    cxt->addComponent<sprite>(e,spriteMetas[ts.name],0,0,1);
+                    cxt->addComponent<sprite>(e,sheets.at(sheetname),0,0,1);
                 }
                 else if(prop.name == "shoots") {
                     std::string sheetname = prop.value;
                     glog.get() << "\t[loader]: read 'shoots' property: need sheetname:'" << sheetname << "'\n";
                     glog.get().flush();
-                    tmx::tileset ts = tmx::loadTileset(sheetname);
-                    // TODO: don't load more than you need to
-                    if(tilesetMetas.count(ts.name) != 0) {
-                        spriteMetas[ts.name] = tilesetMetas[ts.name];
-                    }
-                    else if(spriteMetas.count(ts.name) == 0) {
-                        spriteMetas[ts.name] = loadTileset(ts,renderer);
-                    }
-                    cxt->addComponent<shoots>(e,12,spriteMetas[ts.name]);
+                    cxt->addComponent<shoots>(e,12,sheets.at(sheetname));
                 }
                 else if(prop.name == "collide") {
                     cxt->addComponent<collide>(e,vbox);
@@ -348,15 +387,7 @@ void Loader::populateTilemap(const std::string& mapname, SDL_Renderer* renderer)
                     std::string sheetname = prop.value;
                     glog.get() << "\t[loader]: read 'cursorsprite' property: need sheetname:'" << sheetname << "'\n";
                     glog.get().flush();
-                    tmx::tileset ts = tmx::loadTileset(sheetname);
-                    // TODO: don't load more than you need to
-                    if(tilesetMetas.count(ts.name) != 0) {
-                        spriteMetas[ts.name] = tilesetMetas[ts.name];
-                    }
-                    else if(spriteMetas.count(ts.name) == 0) {
-                        spriteMetas[ts.name] = loadTileset(ts,renderer);
-                    }
-                    //cxt->addComponent<sprite>(e,spriteMetas[ts.name],0,0,0,cursor(0.0f,0.0f));
+                    //cxt->addComponent<sprite>(e,sheets.at(sheetname),0,0,0,cursor(0.0f,0.0f));
                 }
             }
         }
@@ -366,12 +397,16 @@ void Loader::populateTilemap(const std::string& mapname, SDL_Renderer* renderer)
 // de-allocate any textures manually
 void Loader::destroySDLTextures() {
     for(auto st : tilemapMetas) {
-        for(SDL_Texture * l : st.second->layers) {
-            if(l != nullptr) {
-                SDL_DestroyTexture(l);
-            }
+        for(auto& l : st.second->layers) {
+            l->release();
+        }
+    }
+    for(SDL_Texture* page : atlasPages) {
+        if(page != nullptr) {
+            SDL_DestroyTexture(page);
         }
     }
+    atlasPages.clear();
 }
 
 // instantiate a context, and return it
@@ -381,18 +416,9 @@ std::shared_ptr<Context> Loader::getTilemapContext(const std::string& mapname)
     auto cxt = contexts[mapname];
     // create background entity
     entity e = cxt->addEntity();
-    SDL_Texture* t = tilemapMetas[mapname]->layers.back();
     auto [w, h] = getTilemapSize(mapname);
-    // add position component
     cxt->addComponent<position>(e,0,0);
-    // add sprite component
-    auto pTS = std::make_shared<tilesetMeta>();
-    pTS->tex = t;
-    pTS->numCols = 1;
-    pTS->numRows = 1;
-    pTS->tilewidth = w;
-    pTS->tileheight = h;
-    cxt->addComponent<sprite>(e,pTS,0,0,0);
+    cxt->addComponent<tilelayer>(e,tilemapMetas[mapname]->layers.back());
     glog.get() << "[loader]: added background entity w/ size " << w << " x " << h << "\n";
     glog.get().flush();
     return cxt;
@@ -401,10 +427,18 @@ std::shared_ptr<Context> Loader::getTilemapContext(const std::string& mapname)
 // get size of a tilemap's base layer
 std::pair<unsigned,unsigned> Loader::getTilemapSize(const std::string& mapname) {
     assert(contexts.count(mapname) == 1);
-    // query texture
-    Uint32 format;
-    int access;
-    int w, h;
-    SDL_QueryTexture(tilemapMetas[mapname]->layers.back(), &format, &access, &w, &h);
+    auto& layer = tilemapMetas[mapname]->layers.back();
+    unsigned w = layer->width(), h = layer->height();
     return std::make_pair(w,h);
+}
+// get size of a tilemap's tiles
+std::pair<unsigned,unsigned> Loader::getTileSize(const std::string& mapname) {
+    assert(tilemapMetas.count(mapname) == 1);
+    tmx::tilemap& tm = tilemapMetas[mapname]->tm;
+    return std::make_pair(tm.tilewidth, tm.tileheight);
+}
+
+float Loader::getSpriteReach(const std::string& mapname) {
+    assert(tilemapMetas.count(mapname) == 1);
+    return float(tilemapMetas[mapname]->spriteExtent);
 }
\ No newline at end of file
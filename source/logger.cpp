@@ -1,10 +1,32 @@
 #include "logger.hpp"
 
+#include <unordered_map>
+
 Logger::Logger(std::string logfilename) {
     filename = logfilename;
     ofs.open(filename, std::ofstream::out);
+    owner = std::this_thread::get_id();
+}
+Logger::~Logger() {
+    sync();
+    ofs.close();
+}
+std::ostream& Logger::get() {
+    if(std::this_thread::get_id() == owner) return ofs;
+    // buffers are owned by the logger, so they outlive the threads using them
+    thread_local std::unordered_map<const Logger*,std::ostringstream*> mine;
+    std::ostringstream*& buf = mine[this];
+    if(buf == nullptr) {
+        std::lock_guard<std::mutex> lock(buffersMutex);
+        buffers.push_back(std::make_unique<std::ostringstream>());
+        buf = buffers.back().get();
+    }
+    return *buf;
+}
+void Logger::sync() {
+    std::lock_guard<std::mutex> lock(buffersMutex);
+    for(auto& buf : buffers) {
+        ofs << buf->str();
+        buf->str("");
+    }
 }
-Logger::~Logger() { ofs.close(); }
-std::ofstream& Logger::get() {
-    return ofs;
-}
\ No newline at end of file
@@ -3,6 +3,11 @@
 #include <SDL_image.h>
 #include <SDL_ttf.h>
 
+// STL
+#include <algorithm>
+#include <cmath>
+#include <string>
+
 // generates context using tilemap & tileset files
 #include "loader.hpp"
 // ECS systems, instantiated here
@@ -13,6 +18,9 @@
 // game logging stream instance (extern-ed to loader and system updates)
 #include "logger.hpp"
 Logger glog("log.txt");
+// worker threads (extern-ed to systems for data-parallel updates)
+#include "jobs.hpp"
+ThreadPool jobs;
 
 // const screen settings
 const unsigned screenWidth = 1280;
@@ -20,6 +28,8 @@ const unsigned screenHeight = 720;
 
 // handles a single event
 bool handleInput(systems::Input& iSys, SDL_Event event);
+// numeric command line option "--name=value" (fallback if absent)
+float argValue(int argc, char* argv[], const std::string& name, float fallback);
 
 // ENTRY POINT
 int main(int argc, char* argv[]) {
@@ -27,6 +37,8 @@ int main(int argc, char* argv[]) {
     const std::string resourceDirectory = "resources";
     // Load Game
     Loader loader("resources");
+    //     --merge-collision=0   one static box per tile box, for comparison (default 1: merged)
+    loader.setCollisionMerging(argValue(argc, argv, "--merge-collision=", 1.f) != 0.f);
     loader.loadTilemap("forest.tmx", "testmap");
 
     // Load Window + Graphics
@@ -64,31 +76,64 @@ int main(int argc, char* argv[]) {
     // input
     systems::Input inputSystem;
     // physics
-    systems::Position positionSystem;
-    systems::Velocity velocitySystem;
-    systems::Acceleration accelerationSystem;
-    systems::Collision collisionSystem;
+    systems::Integrator integratorSystem;
     // entity state
     systems::Direction directionSystem;
     systems::CombatAI combatSystem;
 
+    // Schedule simulation systems: registration order is the logical order,
+    // systems with disjoint read / write sets run in parallel on the pool
+    //     (rendering stays on the main thread, after the simulation)
+    Scheduler simulation(jobs);
+    float dt = 0.f;
+    //  these update velocity components, which the collision system uses for resolution
+    simulation.add<systems::Input>("input", [&] { inputSystem.update(*cxt,dt); });
+    //  TODO(jllusty): when entities have velocities set, be careful about the order of operations
+    //                 so that they are not decellarated to a velocity below their maximal velocity
+    simulation.add<systems::Direction>("direction", [&] { directionSystem.update(*cxt); });
+    simulation.add<systems::Bullet>("bullet", [&] { systems::bul.update(*cxt); });
+    simulation.add<systems::CombatAI>("combat", [&] { combatSystem.update(*cxt,dt); });
+    //  force -> acceleration -> velocity, ahead of collision so it checks the motion to be made
+    simulation.add<systems::Integrator>("accelerate", [&] { integratorSystem.accelerate(*cxt,dt); });
+    //  updates velocity components based on results of collision resolution
+    simulation.add<systems::Collision>("collision update", [&] { systems::collider.update(*cxt); });
+    simulation.add<systems::Collision>("collision resolve", [&] { systems::collider.resolve(*cxt,dt); });
+    //  velocity -> position, after collision resolution has adjusted velocities
+    simulation.add<systems::Integrator>("move", [&] { integratorSystem.move(*cxt,dt); });
+    //  puts idle bodies to sleep / wakes disturbed ones (applied at the sync point)
+    simulation.add<systems::Sleep>("sleep", [&] { systems::sleeper.update(*cxt); });
+
     // TTF tests
     TTF_Font* font = TTF_OpenFont("resources\\Azeret_Mono\\static\\AzeretMono-Black.ttf",26);
     if(font == nullptr) {
         glog.get() << "[main thread]: Could not load font. TTF_OpenFont: " << TTF_GetError() << "\n";
     }
     systems::ui.font = font;
+    systems::spr.reach = loader.getSpriteReach("testmap");
 
-    // Main Loop: cap framerate to 60 FPS
-    Timer capTimer;
+    // Main Loop: fixed simulation ticks, rendering decoupled & interpolated
+    //     --tick-rate=N   simulation ticks per second (default 60)
+    //     --max-steps=N   ticks simulated per frame at most, excess time is dropped (default 5)
+    //     --fps=N         frame rate cap, 0 for uncapped (default 144)
+    //     --layer-budget=N  texture memory for tilemap layer chunks, in MiB (default 64)
+    const float tickRate = std::max(1.f, argValue(argc, argv, "--tick-rate=", 60.f));
+    const int maxSteps = std::max(1, int(argValue(argc, argv, "--max-steps=", 5.f)));
+    const float frameRate = argValue(argc, argv, "--fps=", 144.f);
+    systems::lay.budget = size_t(std::max(0.f, argValue(argc, argv, "--layer-budget=", 64.f))*float(1 << 20));
+    const float tickTime{ 1.0f/tickRate };
+    glog.get() << "[main thread]: simulating at " << tickRate << " Hz, rendering at "
+               << (frameRate > 0.f ? frameRate : 0.f) << " Hz (0: uncapped)\n";
+    dt = tickTime;
+    Timer frameTimer;
+    frameTimer.tick();
     bool running = true;
     float accumulatedSeconds = 0.f;
-    const int updateFrequency{ 60 };
-    const float cycleTime{ 1.0f/updateFrequency };
+    Timer capTimer;
     while(running) {
-        // start timer to measure how long the "work" takes
+        // time since the previous frame, start timer to measure how long the "work" takes
+        frameTimer.tick();
         capTimer.tick();
-        accumulatedSeconds += capTimer.elapsed();
+        accumulatedSeconds += frameTimer.elapsed();
 
         SDL_Event event;
         // poll until all events are handled
@@ -104,45 +149,44 @@ int main(int argc, char* argv[]) {
             }
         }
 
-        // do not throw exception on floating-point comparison for timer
-        if(std::isgreater(accumulatedSeconds,cycleTime))
-        {
-            // reset accumulator
-            accumulatedSeconds = 0.f;
-
-            // update systems
-            static Timer physicsTimer;
-            physicsTimer.tick();
-            float dt = physicsTimer.elapsed();
-            glog.get() << "[main thread]: dt = " << dt << "\n";
-            //  these update velocity components, which the collision system uses for resolution
-            inputSystem.update(*cxt);
-            accelerationSystem.update(*cxt);
-            velocitySystem.update(*cxt,dt);
-            //  TODO(jllusty): when entities have velocities set, be careful about the order of operations
-            //                 so that they are not decellarated to a velocity below their maximal velocity
-            directionSystem.update(*cxt);
-            systems::bul.update(*cxt);
-            combatSystem.update(*cxt);
-            //  updates velocity components based on results of collision resolution
-            collisionSystem.update(*cxt);
-            collisionSystem.resolve(*cxt,dt);
-            //  updates position unconditionally on velocity
-            positionSystem.update(*cxt,dt);
-
-            // update camera
-            systems::cam.update(*cxt,*renderer);
-            // draw systems
-            SDL_RenderClear(renderer);
-            systems::spr.update(*cxt);
-            systems::ui.update(*cxt, *renderer);
-            systems::graphics.update(*renderer);
-
-            // draw game
-            SDL_RenderPresent(renderer);
-            // newline in log
-            glog.get() << "\n";
-        } 
+        // update systems in whole ticks, carrying leftover time to the next frame
+        int steps = 0;
+        while(!std::isless(accumulatedSeconds,tickTime) && steps < maxSteps) {
+            accumulatedSeconds -= tickTime;
+            ++steps;
+            systems::interp.snapshot(*cxt);
+            simulation.run();
+            //  sync point: apply spawns / despawns requested during the update
+            systems::commands(*cxt).apply(*cxt);
+            glog.sync();
+        }
+        glog.get() << "[main thread]: frame time = " << frameTimer.elapsed() << " s, " << steps << " ticks\n";
+        // too far behind (e.g. a stall): drop whole ticks rather than spiral
+        if(!std::isless(accumulatedSeconds,tickTime)) {
+            glog.get() << "[main thread]: dropping " << int(accumulatedSeconds/tickTime) << " ticks\n";
+            accumulatedSeconds = std::fmod(accumulatedSeconds,tickTime);
+        }
+        systems::interp.alpha = accumulatedSeconds/tickTime;
+
+        // update camera
+        systems::cam.update(*cxt,*renderer);
+        // draw systems
+        SDL_RenderClear(renderer);
+        systems::lay.update(*cxt, *renderer);
+        systems::spr.update(*cxt);
+        systems::ui.update(*cxt, *renderer);
+        systems::graphics.update(*renderer);
+
+        // draw game
+        SDL_RenderPresent(renderer);
+        // newline in log
+        glog.get() << "\n";
+
+        // cap frame rate: sleep off the rest of the frame
+        capTimer.tick();
+        if(frameRate > 0.f && std::isless(capTimer.elapsed(),1.0f/frameRate)) {
+            SDL_Delay(Uint32(1000.0f*(1.0f/frameRate - capTimer.elapsed())));
+        }
     }
 
     // Clear Engine-Requested SDL_Texture memory
@@ -160,6 +204,22 @@ int main(int argc, char* argv[]) {
     return 0;
 }
 
+// numeric command line option "--name=value"
+float argValue(int argc, char* argv[], const std::string& name, float fallback) {
+    for(int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if(arg.compare(0, name.size(), name) == 0) {
+            try {
+                return std::stof(arg.substr(name.size()));
+            }
+            catch(const std::exception&) {
+                glog.get() << "[main thread]: ignoring malformed option '" << arg << "'\n";
+            }
+        }
+    }
+    return fallback;
+}
+
 // pass input to input system (move into systems::Input)
 bool handleInput(systems::Input& iSys, SDL_Event event) {
     bool running = true;
@@ -0,0 +1,23 @@
+#include "system.hpp"
+
+#include "logger.hpp"
+extern Logger glog;
+
+void Scheduler::addTask(const std::string& name, signature read, signature write, std::function<void()> run) {
+    // conflict: either side writes something the other touches
+    size_t wave = 0;
+    for(const Task& t : tasks) {
+        bool conflict = (t.write & (read | write)).any() || (t.read & write).any();
+        if(conflict && t.wave + 1 > wave) wave = t.wave + 1;
+    }
+    tasks.push_back(Task{ name, read, write, run, wave });
+    if(wave >= waves.size()) waves.resize(wave + 1);
+    waves[wave].push_back(tasks.back().run);
+    glog.get() << "[scheduler]: system '" << name << "' runs in wave " << wave << "\n";
+}
+// run all waves, in order
+void Scheduler::run() {
+    for(auto& wave : waves) {
+        pool.run(wave);
+    }
+}
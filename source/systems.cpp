@@ -1,84 +1,117 @@
 #include "systems.hpp"
 
+#include <algorithm>
 #include <cassert>
-#include <queue>
 #include <cmath>
+#include <chrono>
+#include <limits>
 #include "sdl_util.hpp"
+#include "integrate.hpp"
 
 #include "logger.hpp"
 extern Logger glog;
+#include "jobs.hpp"
+extern ThreadPool jobs;
 
 namespace systems {
-    // instances
+    // instances (their per-entity state lives in each context)
     //  entity lifetime managers
     Bullet bul{ };
     //  rendering managers
+    Layers lay{ };
     Sprite spr{ };
     UI ui{ };
     Graphics graphics{ };
 
+    //  collision detection & contact events
+    Collision collider{ };
+    //  body sleeping
+    Sleep sleeper{ };
+    // render interpolation
+    Interpolation interp{ };
     // camera instance
     Camera cam{ };
     // debug system
     Debug dbg{ };
-    // position system
-    //   (position,velocity) ? (position)
-    void Position::update(Context &c, float dt) {
-        for(auto e : c.getEntities()) {
-            if(c.hasComponents<position,velocity>(e)) {
-                c.getComponent<position>(e)->x += dt * c.getComponent<velocity>(e)->x;
-                c.getComponent<position>(e)->y += dt * c.getComponent<velocity>(e)->y;
-            }
-        }
+    // integrator
+    static_assert(sizeof(position) == 2*sizeof(float) && sizeof(velocity) == 2*sizeof(float) &&
+                  sizeof(acceleration) == 2*sizeof(float) && sizeof(force) == 2*sizeof(float) &&
+                  sizeof(mass) == sizeof(float), "the integration kernels read components as packed floats\n");
+    void Integrator::accelerate(Context& c, float dt) {
+        auto full = [&c](entity e) {
+            return c.hasComponents<velocity,acceleration,force,mass>(e);
+        };
+        auto sleeping = [&c](entity e) {
+            return c.hasComponents<asleep>(e);
+        };
+        std::vector<std::function<void()>> work;
+        // full bodies: SIMD kernel (every entity of a chunk shares its archetype,
+        // so the first one speaks for all)
+        c.chunks<velocity,acceleration,force,mass>(
+            [&](size_t n, entity* es, velocity* v, acceleration* a, force* f, mass* m) {
+                if(sleeping(es[0])) return;
+                work.emplace_back([=] { ::accelerate(n, &v->x, &a->x, &f->x, &m->m, dt); });
+            });
+        jobs.run(work);
+        // partial bodies, stage by stage (force is optional for acceleration)
+        jobs.parallel_for(c.view<acceleration,mass>(), [&](entity e, acceleration& a, mass& m) {
+            if(full(e) || sleeping(e)) return;
+            auto f = c.getComponent<force>(e);
+            a.x = (f != nullptr ? f->x : 0.f) / m.m;
+            a.y = (f != nullptr ? f->y : 0.f) / m.m;
+        });
+        jobs.parallel_for(c.view<velocity,acceleration>(), [&](entity e, velocity& v, acceleration& a) {
+            if(full(e) || sleeping(e)) return;
+            v.x += dt * a.x;
+            v.y += dt * a.y;
+        });
     }
-    // velocity system
-    //     TODO(jllusty): maybe track whether entities are or are not moving
-    void Velocity::update(Context& c, float dt) {
-        for(auto e : c.getEntities()) {
-            if(c.hasComponents<velocity,acceleration>(e)) {
-                c.getComponent<velocity>(e)->x += dt * c.getComponent<acceleration>(e)->x;
-                c.getComponent<velocity>(e)->y += dt * c.getComponent<acceleration>(e)->y;
-            }
-        }
+    void Integrator::move(Context& c, float dt) {
+        std::vector<std::function<void()>> work;
+        c.chunks<position,velocity>([&](size_t n, entity* es, position* p, velocity* v) {
+            if(c.hasComponents<asleep>(es[0])) return;
+            work.emplace_back([=] { advance(n, &p->x, &v->x, dt); });
+        });
+        jobs.run(work);
     }
-    // acceleration system
-    void Acceleration::update(Context& c) {
-        for(auto e : c.getEntities()) {
-            if(c.hasComponents<acceleration,mass>(e)) {
-                float m = c.getComponent<mass>(e)->m;
-                float rx = 0.f, ry = 0.f;       // resultant force
-                // body force
-                if(c.hasComponents<force>(e)) {
-                    rx += c.getComponent<force>(e)->x;
-                    ry += c.getComponent<force>(e)->y;
-                }
-                // kinetic friction
-                /*
-                if(c.hasComponents<velocity,friction>(e)) {
-                    float fK = c.getComponent<friction>(e)->coeff;
-                    // get direction of velocity
-                    float& ux = c.getComponent<velocity>(e)->x;
-                    float& uy = c.getComponent<velocity>(e)->y;
-                    float mag = sqrtf(ux*ux + uy*uy);
-                    // needs sufficiency condition for application, otherwise, will cause annoying shaking
-                    if(mag > 0.000001) {
-                        float fKx = ux / mag * fK * m;
-                        float fKy = uy / mag * fK * m;
-                        rx -= fKx;
-                        ry -= fKy;
-                        glog.get() << "[systems::Acceleration]: applying frictional force F = (" << rx << "," << ry << ")\n";
-                    }
-                }
-                */
-                c.getComponent<acceleration>(e)->x = rx / m;
-                c.getComponent<acceleration>(e)->y = ry / m;
+    // sleep system
+    //     velocity / force writes are not intercepted: a sleeping body is checked for
+    //     them here, one tick late (a woken body is integrated from the tick after)
+    void Sleep::update(Context& c) {
+        const float t2 = threshold*threshold;
+        auto& idle = c.state<State>().idle;
+        c.view<velocity>().each([&](entity e, velocity& v) {
+            size_t i = entityIndex(e);
+            if(i >= idle.size()) idle.resize(i+1, std::make_pair(nullEntity, 0u));
+            if(idle[i].first != e) idle[i] = std::make_pair(e, 0u);
+            auto f = c.getComponent<force>(e);
+            bool still = v.x*v.x + v.y*v.y < t2 && (f == nullptr || f->x*f->x + f->y*f->y < t2);
+            if(c.hasComponents<asleep>(e)) {
+                if(!still) wake(c, e);
             }
-        }
+            else if(!still) {
+                idle[i].second = 0;
+            }
+            else if(++idle[i].second == ticks) {
+                commands(c).addComponent<asleep>(e);
+            }
+        });
+    }
+    void Sleep::wake(Context& c, entity e) {
+        if(!c.hasComponents<asleep>(e)) return;
+        commands(c).removeComponent<asleep>(e);
+        auto& idle = c.state<State>().idle;
+        size_t i = entityIndex(e);
+        if(i < idle.size()) idle[i] = std::make_pair(e, 0u);
     }
     // input system
-    void Input::update(Context &c) {
+    void Input::update(Context &c, float dt) {
         // debug toggle
         dbg.showCollision = debugToggle;
+        // pick the entity under the mouse
+        auto [wX, wY] = cam.getWorldCoordinates(mouseX,mouseY);
+        auto under = c.queryCircle(vec2f(wX,wY), 0.f);
+        hovered = under.empty() ? nullEntity : under.front();
         int count = ((Wd)?1:0) + ((Ad)?1:0) + ((Sd)?1:0) + ((Dd)?1:0);
         bool only = (count == 1);
         for(auto e : c.getEntities()) {
@@ -108,8 +141,8 @@ namespace systems {
             }
             // camera zoom debug
             else if(c.hasComponents<camera>(e)) {
-                if(upArr) c.getComponent<camera>(e)->zoom += 1.0f/60.f;
-                else if(downArr) c.getComponent<camera>(e)->zoom -= 1.0f/60.f;
+                if(upArr) c.getComponent<camera>(e)->zoom += dt;
+                else if(downArr) c.getComponent<camera>(e)->zoom -= dt;
             }
             // mouse position debug
             if(c.hasComponents<position,cursor,sprite,shoots>(e)) {
@@ -117,13 +150,12 @@ namespace systems {
                 c.getComponent<cursor>(e)->y = mouseY;
                 if(mouseLeftd && !mousePressing) {
                     mousePressing = true;
-                    auto [wX,wY] = cam.getWorldCoordinates(mouseX,mouseY);
                     float x = c.getComponent<position>(e)->x;
                     float y = c.getComponent<position>(e)->y;
                     vec2f dir = vec2f(wX,wY)-vec2f(x,y);
                     float len = sqrtf(dir.x*dir.x + dir.y*dir.y);
                     dir = dir/len;
-                    bul.shotsToFire.emplace_front(e,dir);
+                    c.state<Bullet::State>().shotsToFire.emplace_front(e,dir);
                 }
                 else if(!mouseLeftd) {
                     mousePressing = false;
@@ -134,6 +166,8 @@ namespace systems {
     // bullet system
     void Bullet::update(Context &c) {
         // shoot bullets requested by other systems
+        auto& shotsToFire = c.state<State>().shotsToFire;
+        CommandBuffer& commands = systems::commands(c);
         while(!shotsToFire.empty()) {
             auto[e, dir] = shotsToFire.front(); shotsToFire.pop_front();
 
@@ -144,10 +178,9 @@ namespace systems {
             // needs to be spawned in world coordinates, not screen coordinates
             auto pTS = c.getComponent<shoots>(e)->pTS;
             
-            entity spawned = c.addEntity();
-            bullets.push_back(spawned);
+            entity spawned = commands.addEntity();
             float dx = dir.x, dy = dir.y;
-            c.addComponent<position>(spawned, x, y);
+            commands.addComponent<position>(spawned, x, y);
             // galilean relativity, baby
             float speed = 60.0f;
             dx *= speed;
@@ -156,27 +189,46 @@ namespace systems {
                 dx += c.getComponent<velocity>(e)->x; 
                 dy += c.getComponent<velocity>(e)->y; 
             }
-            c.addComponent<velocity>(spawned, dx, dy);
+            commands.addComponent<velocity>(spawned, dx, dy);
             rectf vbox = pTS->tileMetas[0]->boxes[0];
-            c.addComponent<volume>(spawned, vbox);
-            //c.addComponent<collide>(spawned,0.f,0.f);
-            c.addComponent<mass>(spawned, 1.f);
-            c.addComponent<bullet>(spawned, e, false);
-            c.addComponent<sprite>(spawned,pTS,0,0,1);
-            glog.get() << "[systems::Bullet]: spawned an entity! id = " << spawned << "\n";
+            commands.addComponent<volume>(spawned, vbox);
+            //commands.addComponent<collide>(spawned,0.f,0.f);
+            commands.addComponent<mass>(spawned, 1.f);
+            commands.addComponent<bullet>(spawned, e, false);
+            commands.addComponent<fast>(spawned);
+            commands.addComponent<sprite>(spawned,pTS,0,0,1);
+            glog.get() << "[systems::Bullet]: queued an entity spawn\n";
         }
-        // delete bullets that hit shit
-        for(auto it = bullets.begin(); it != bullets.end();) {
-            if(c.getComponent<bullet>(*it)->hit) {
-                c.removeEntity(*it);
-                glog.get() << "[systems::Bullet]: despawned an entity! id = " << *it << "\n";
-                it = bullets.erase(it);
-            }
-            else {
-                ++it;
+        // delete bullets that hit shit (last tick's new contacts)
+        for(const contact& ct : Collision::contacts(c)) {
+            if(ct.state != contact::phase::begin) continue;
+            for(entity e : { ct.a, ct.b }) {
+                auto b = c.getComponent<bullet>(e);
+                if(b != nullptr && b->hit && c.alive(e)) {
+                    commands.removeEntity(e);
+                    glog.get() << "[systems::Bullet]: queued despawn of entity id = " << e << "\n";
+                }
             }
         }
     }
+    // interpolation
+    void Interpolation::snapshot(Context& c) {
+        auto& previous = c.state<State>().previous;
+        c.view<position,velocity>().each([&previous](entity e, position& p, velocity&) {
+            size_t i = entityIndex(e);
+            if(i >= previous.size()) previous.resize(i+1, std::make_pair(nullEntity, vec2f(0.f,0.f)));
+            previous[i] = std::make_pair(e, vec2f(p.x,p.y));
+        });
+    }
+    vec2f Interpolation::at(Context& c, entity e) {
+        auto p = c.getComponent<position>(e);
+        size_t i = entityIndex(e);
+        // spawned since the last snapshot, or not moving: draw where it is
+        const State* s = c.findState<State>();
+        if(s == nullptr || i >= s->previous.size() || s->previous[i].first != e) return vec2f(p->x,p->y);
+        vec2f q = s->previous[i].second;
+        return vec2f(q.x + alpha*(p->x - q.x), q.y + alpha*(p->y - q.y));
+    }
     // camera system
     void Camera::update(Context &c, SDL_Renderer& r) {
         // get viewport dimensions
@@ -188,10 +240,14 @@ namespace systems {
         for(entity e: c.getEntities()) {
             if(c.hasComponents<camera>(e)) {
                 entity target = c.getComponent<camera>(e)->target;
-                if(c.hasComponents<position,volume>(target)) {
+                if(!c.alive(target)) {
+                    glog.get() << "[systems::Camera]: camera target has despawned\n";
+                }
+                else if(c.hasComponents<position,volume>(target)) {
                     // center of screen
-                    cx = c.getComponent<position>(target)->x + c.getComponent<volume>(target)->box.w/2.0f;
-                    cy = c.getComponent<position>(target)->y + c.getComponent<volume>(target)->box.h/2.0f;
+                    vec2f p = interp.at(c,target);
+                    cx = p.x + c.getComponent<volume>(target)->box.w/2.0f;
+                    cy = p.y + c.getComponent<volume>(target)->box.h/2.0f;
                     glog.get() << "[systems::Camera]: world position of center of screen: (" << cx << "," << cy << ")\n";
                 }
                 else {
@@ -210,6 +266,15 @@ namespace systems {
     std::pair<float,float> Camera::getCameraCoordinates(float x, float y) {
         return { (x-cx)*zoom+float(vw)/2.f, (y-cy)*zoom+float(vh)/2.f };
     }
+    rectf Camera::getWorldView() {
+        // degenerate zoom: the whole world is in view
+        if(zoom <= 0.f) {
+            const float big = std::numeric_limits<float>::max()/4.f;
+            return rectf(-big, -big, 2.f*big, 2.f*big);
+        }
+        auto [x, y] = getWorldCoordinates(0.f, 0.f);
+        return rectf(x, y, float(vw)/zoom, float(vh)/zoom);
+    }
     // ui system
     //     currently needs a renderer as it makes textures actively using
     //     a rendering context
@@ -217,36 +282,40 @@ namespace systems {
         std::vector<entity> cursors;
         // text color
         SDL_Color fg = {125,0,0};
-        // combat info
-        for(entity e : c.getEntities()) {
-            if(c.hasComponents<position,combat>(e)) {
-                // render health string into texture
-                std::string textStr = "HEALTH: " + std::to_string(c.getComponent<combat>(e)->health);
-                SDL_Surface* textSurface = TTF_RenderText_Solid(font, textStr.c_str(), fg);
-                SDL_Texture* textTexture = SDL_CreateTextureFromSurface(&r, textSurface);
-                SDL_FreeSurface(textSurface);
-                // query texture for width & height
-                int w, h;
-                int access;
-                Uint32 format;
-                SDL_QueryTexture(textTexture, &format, &access, &w, &h);
-                float x = c.getComponent<position>(e)->x;
-                float y = c.getComponent<position>(e)->y;
-                float dx = w/2;
-                float dy = h;
-                // center text above entity
-                if(c.hasComponents<volume>(e)) {
-                    dx -= c.getComponent<volume>(e)->box.w;
-                }
-                SDL_Rect src = {0, 0, w, h};
-                SDL_Rect dst;
-                auto [cX, cY] = cam.getCameraCoordinates(x,y);
-                dst.x = cX-dx;
-                dst.y = cY-dy;
-                dst.w = src.w; dst.h = src.h;
-                // push renderable to graphics system
-                graphics.renderQueue.emplace_back(textTexture,src,dst);
+        // combat info (labels are drawn unscaled, so on screen they span w/zoom x h/zoom world units)
+        rectf view = cam.getWorldView();
+        // labels are at most as large as the longest one, and reach that far beyond the box
+        float reach = 0.f;
+        int longestW, longestH;
+        std::string longest = "HEALTH: " + std::to_string(std::numeric_limits<decltype(combat::health)>::max());
+        if(cam.zoom > 0.f && TTF_SizeText(font, longest.c_str(), &longestW, &longestH) == 0) {
+            reach = float(std::max(longestW, longestH))/cam.zoom;
+        }
+        for(entity e : cam.inView<position,combat>(c, reach + cullMargin)) {
+            // size of the health string, to test the label against the view before rendering it
+            std::string textStr = "HEALTH: " + std::to_string(c.getComponent<combat>(e)->health);
+            int w, h;
+            if(TTF_SizeText(font, textStr.c_str(), &w, &h) != 0) continue;
+            auto [x, y] = interp.at(c,e);
+            float dx = w/2;
+            float dy = h;
+            // center text above entity
+            if(c.hasComponents<volume>(e)) {
+                dx -= c.getComponent<volume>(e)->box.w;
             }
+            if(cam.zoom > 0.f && !collision(rectf(x - dx/cam.zoom, y - dy/cam.zoom, w/cam.zoom, h/cam.zoom), view)) continue;
+            // render health string into texture
+            SDL_Surface* textSurface = TTF_RenderText_Solid(font, textStr.c_str(), fg);
+            SDL_Texture* textTexture = SDL_CreateTextureFromSurface(&r, textSurface);
+            SDL_FreeSurface(textSurface);
+            SDL_Rect src = {0, 0, w, h};
+            SDL_Rect dst;
+            auto [cX, cY] = cam.getCameraCoordinates(x,y);
+            dst.x = cX-dx;
+            dst.y = cY-dy;
+            dst.w = src.w; dst.h = src.h;
+            // push renderable to graphics system
+            graphics.renderQueue.emplace_back(textTexture,src,dst);
             // other UI things to be draw in camera coords
             /*for(entity e : cursors) {
                 auto s = c.getComponent<sprite>(e);
@@ -271,75 +340,123 @@ namespace systems {
         }
     }
     // sprite system
-    void Sprite::update(Context& c) {
-        // order sprites by z
-        using ep = std::pair<entity,float>;
-        std::vector<ep> eps;
-        auto cmp = [](ep ep1, ep ep2) -> bool
-        {
-            return(ep1.second > ep2.second);
-        };
-        std::priority_queue pq(cmp,eps);   
-        std::priority_queue tops(cmp,eps); // draw last by request
-        for(entity e : c.getEntities()) {
-            // sprites
-            if(c.hasComponents<position,sprite>(e)) {
-                pq.emplace(e,c.getComponent<sprite>(e)->z + c.getComponent<position>(e)->y);
+    void Layers::update(Context& c, SDL_Renderer& r) {
+        size_t layers = 0;
+        c.view<position,tilelayer>().each([&](entity, position&, tilelayer&) { ++layers; });
+        if(layers == 0) return;
+        rectf view = cam.getWorldView();
+        c.view<position,tilelayer>().each([&](entity, position& p, tilelayer& l) {
+            // stream in layer pixels
+            rectf local(view.x - p.x, view.y - p.y, view.w, view.h);
+            l.chunks->stream(r, local, prefetchMargin, budget/layers);
+            for(size_t k : l.chunks->drawn()) {
+                SDL_Texture* tex = l.chunks->texture(k);
+                if(tex == nullptr) continue;
+                SDL_Rect b = l.chunks->bounds(k);
+                SDL_Rect src = { 0, 0, b.w, b.h };
+                // both edges through the camera, so neighbouring chunks meet exactly
+                auto [x0, y0] = cam.getCameraCoordinates(p.x + b.x, p.y + b.y);
+                auto [x1, y1] = cam.getCameraCoordinates(p.x + b.x + b.w, p.y + b.y + b.h);
+                SDL_Rect dst = { int(x0), int(y0), int(x1) - int(x0), int(y1) - int(y0) };
+                graphics.renderQueue.emplace_back(tex, src, dst);
             }
-        }
-        // apply camera transform
-        while(!pq.empty()) {
-            auto [e, zl] = pq.top(); pq.pop();
+        });
+    }
+    void Sprite::update(Context& c) {
+        // sprites on screen, in camera coordinates
+        rectf view = cam.getWorldView();
+        DrawList& list = c.state<State>().list;
+        list.clear();
+        for(entity e : cam.inView<position,sprite>(c, reach + cullMargin)) {
             auto s = c.getComponent<sprite>(e);
-            float x = c.getComponent<position>(e)->x;
-            float y = c.getComponent<position>(e)->y;
-            unsigned row = s->row;
-            unsigned col = s->col;
-            SDL_Rect src = s->pTS->get(row,col);
-            // transform to camera coordinates
+            auto [x, y] = interp.at(c,e);
+            SDL_Rect src = s->pTS->get(s->row,s->col);
+            if(!collision(rectf(x, y, float(src.w), float(src.h)), view)) continue;
             SDL_Rect dst;
             auto [cx, cy] = cam.getCameraCoordinates(x,y);
             dst.x = cx;
             dst.y = cy;
             dst.w = src.w*cam.zoom; dst.h = src.h*cam.zoom;
-            graphics.renderQueue.emplace_back(s->pTS->tex, src, dst);
+            list.add(entityIndex(e), s->z + y, LRenderable(s->pTS->tex, src, dst));
+        }
+        // order by depth
+        list.sort();
+        drawn = unsigned(list.size());
+        for(const DrawList::Item& d : list.draws()) {
+            graphics.renderQueue.push_back(d.r);
         }
     }
     void Graphics::update(SDL_Renderer& r) {
+        // group the queue into batches
+        batches.clear();
+        quads = 0;
         while(!renderQueue.empty()) {
-            auto rParams = renderQueue.front(); renderQueue.pop_front();
-            SDL_Texture* tex = rParams.texPtr;
-            SDL_Rect& src = rParams.src; SDL_Rect& dst = rParams.dst;
-            glog.get() << "[systems::Graphics]: calling SDL_RenderCopy on \n";
-            glog.get() << "\tsource = [x = " << src.x << ",y = " << src.y 
-                  << ",w = " << src.w << ",h = " << src.h << "]\n";
-            glog.get() << "\tdest = [x = " << dst.x << ",y = " << dst.y 
-                  << ",w = " << dst.w << ",h = " << dst.h << "]\n";
-            SDL_RenderCopy(&r, tex, &src, &dst);
+            LRenderable q = renderQueue.front(); renderQueue.pop_front();
+            ++quads;
+            // latest batch of the same texture that nothing in between overlaps
+            Batch* into = nullptr;
+            for(size_t k = batches.size(), n = 0; k > 0 && n < lookback; --k, ++n) {
+                Batch& b = batches[k-1];
+                if(b.tex == q.texPtr) {
+                    into = &b;
+                    break;
+                }
+                if(SDL_HasIntersection(&b.bounds, &q.dst)) break;
+            }
+            if(into == nullptr) {
+                batches.push_back(Batch{ q.texPtr, q.dst, {} });
+                into = &batches.back();
+            }
+            else {
+                SDL_UnionRect(&into->bounds, &q.dst, &into->bounds);
+            }
+            into->quads.push_back(q);
+        }
+        // one geometry call per batch
+        drawCalls = 0;
+        const SDL_Color white = { 255, 255, 255, 255 };
+        for(Batch& b : batches) {
+            int tw = 0, th = 0;
+            SDL_QueryTexture(b.tex, nullptr, nullptr, &tw, &th);
+            if(tw == 0 || th == 0) continue;
+            vertices.clear();
+            indices.clear();
+            for(const LRenderable& q : b.quads) {
+                float x0 = float(q.dst.x), y0 = float(q.dst.y);
+                float x1 = float(q.dst.x + q.dst.w), y1 = float(q.dst.y + q.dst.h);
+                float u0 = float(q.src.x)/tw, v0 = float(q.src.y)/th;
+                float u1 = float(q.src.x + q.src.w)/tw, v1 = float(q.src.y + q.src.h)/th;
+                int base = int(vertices.size());
+                vertices.push_back(SDL_Vertex{ { x0, y0 }, white, { u0, v0 } });
+                vertices.push_back(SDL_Vertex{ { x1, y0 }, white, { u1, v0 } });
+                vertices.push_back(SDL_Vertex{ { x0, y1 }, white, { u0, v1 } });
+                vertices.push_back(SDL_Vertex{ { x1, y1 }, white, { u1, v1 } });
+                for(int i : { 0, 1, 2, 2, 1, 3 }) {
+                    indices.push_back(base + i);
+                }
+            }
+            SDL_RenderGeometry(&r, b.tex, vertices.data(), int(vertices.size()), indices.data(), int(indices.size()));
+            ++drawCalls;
         }
+        glog.get() << "[systems::Graphics]: drew " << quads << " quads in " << drawCalls << " draw calls\n";
     }
     // direction system
     //   (velocity) ? (direction)
     void Direction::update(Context& c) {
-        for(auto e : c.getEntities()) {
-            if(c.hasComponents<direction>(e)) {
-                if(c.hasComponents<sprite>(e)) {
-                    auto dir = c.getComponent<direction>(e)->dir;
-                    if(dir == direction::facing::left) {
-                        c.getComponent<sprite>(e)->row = 1;
-                    }
-                    else if(dir == direction::facing::right) {
-                        c.getComponent<sprite>(e)->row = 0;
-                    }
-                    else if(dir == direction::facing::down) {
-                        c.getComponent<sprite>(e)->row = 3;
-                    }
-                    else if(dir == direction::facing::up) {
-                        c.getComponent<sprite>(e)->row = 2;
-                    }
-                }
+        c.view<direction,sprite>().each([](entity, direction& d, sprite& s) {
+            if(d.dir == direction::facing::left) {
+                s.row = 1;
             }
-        }
+            else if(d.dir == direction::facing::right) {
+                s.row = 0;
+            }
+            else if(d.dir == direction::facing::down) {
+                s.row = 3;
+            }
+            else if(d.dir == direction::facing::up) {
+                s.row = 2;
+            }
+        });
     }
     // for entities with indexed collision boxes, update their local boxes
     void Collision::update(Context& c) {
@@ -360,46 +477,106 @@ namespace systems {
     }
     // Collision
     void Collision::resolve(Context& c, float dt) {
-        // accumulate pairwise collisions
+        const float never = std::numeric_limits<float>::infinity();
+        // accumulate pairwise collisions, with their time of impact within the tick
         std::vector<std::pair<entity,entity>> collisions;
-        // accumulate all future rectfs in world coordinates
+        std::vector<float> times;
+        // accumulate all future rectfs in world coordinates, and the moves that lead there
         std::vector<std::pair<entity,rectf>> eRects;
-        for(entity e : c.getEntities()) {
-            if(c.hasComponents<collide>(e) || c.hasComponents<volume>(e)) {
-                // has indexed collision component
-                rectf r(0.f,0.f,0.f,0.f);
-                // get entity-local collision box
-                if(c.hasComponents<collide>(e)) {
-                    r = c.getComponent<collide>(e)->box;
-                }
-                else if(c.hasComponents<volume>(e)){
-                    r = c.getComponent<volume>(e)->box;
-                }
-                // get current entity world position
-                if(c.hasComponents<position>(e)) {
-                    r.x += c.getComponent<position>(e)->x;
-                    r.y += c.getComponent<position>(e)->y;
-                }
-                // has future position: move forward 1 timestep
-                if(c.hasComponents<velocity>(e)) {
-                    r.x += dt * c.getComponent<velocity>(e)->x;
-                    r.y += dt * c.getComponent<velocity>(e)->y;
+        std::vector<vec2f> moves;
+        std::vector<bool> sweeping;
+        std::vector<uint32_t> moving;
+        State& s = c.state<State>();
+        auto& slots = s.slots;
+        c.beginIndex();
+        auto addRect = [&](entity e, rectf r) {
+            uint32_t id = entityIndex(e);
+            if(id >= slots.size()) slots.resize(id+1);
+            slots[id] = uint32_t(eRects.size());
+            // get current entity world position
+            if(auto p = c.getComponent<position>(e)) {
+                r.x += p->x;
+                r.y += p->y;
+            }
+            // has future position: move forward 1 timestep (sleeping bodies stay put, as static)
+            auto v = c.hasComponents<asleep>(e) ? nullptr : c.getComponent<velocity>(e);
+            vec2f d(0.f,0.f);
+            if(v != nullptr) {
+                d = vec2f(dt * v->x, dt * v->y);
+                moving.push_back(eRects.size());
+            }
+            // fast movers occupy their whole path, so the broadphase sees what they pass through
+            bool sweeps = v != nullptr && c.hasComponents<fast>(e);
+            c.index(e, sweeps ? swept(r, d) : rectf(r.x + d.x, r.y + d.y, r.w, r.h), v != nullptr);
+            r.x += d.x;
+            r.y += d.y;
+            eRects.emplace_back(e,r);
+            moves.push_back(d);
+            sweeping.push_back(sweeps);
+        };
+        // box at the start of the tick
+        auto start = [&](uint32_t i) {
+            const rectf& r = eRects[i].second;
+            return rectf(r.x - moves[i].x, r.y - moves[i].y, r.w, r.h);
+        };
+        // indexed collision boxes take precedence over static ones
+        c.view<collide>().each([&](entity e, collide& col) {
+            addRect(e, col.box);
+        });
+        c.view<volume>().each([&](entity e, volume& vol) {
+            if(!c.hasComponents<collide>(e)) addRect(e, vol.box);
+        });
+        // moving boxes against the static tile grid: one pair per mover that hits it
+        c.view<terrain>().each([&](entity t, terrain& ter) {
+            for(uint32_t i : moving) {
+                float toi = sweeping[i] ? ter.grid->timeOfImpact(start(i), moves[i])
+                                     : (ter.grid->collides(eRects[i].second) ? 1.f : never);
+                if(toi <= 1.f) {
+                    collisions.emplace_back(t, eRects[i].first);
+                    times.push_back(toi);
                 }
-                eRects.emplace_back(e,r);
             }
-        }
-        // do collision check
-        for(size_t i = 0; i < eRects.size(); ++i) {
+        });
+        // do collision check on broadphase candidates (swept if either is a fast mover)
+        c.endIndex(s.candidates);
+        for(auto [a, b] : s.candidates) {
+            uint32_t i = slots[a], j = slots[b];
             auto& [e1,r1] = eRects[i];
-            for(size_t j = i+1; j < eRects.size(); ++j) {
-                auto& [e2,r2] = eRects[j];
-                if(collision(r1,r2)) collisions.emplace_back(e1,e2);
+            auto& [e2,r2] = eRects[j];
+            float toi = (sweeping[i] || sweeping[j]) ? timeOfImpact(start(i), moves[i], start(j), moves[j])
+                                               : (collision(r1,r2) ? 1.f : never);
+            if(toi <= 1.f) {
+                collisions.emplace_back(e1,e2);
+                times.push_back(toi);
+            }
+        }
+        // a fast mover only responds to the first thing it hits this tick
+        std::map<entity,float> firstHit;
+        for(size_t k = 0; k < collisions.size(); ++k) {
+            for(entity e : { collisions[k].first, collisions[k].second }) {
+                if(!c.hasComponents<fast>(e)) continue;
+                auto it = firstHit.find(e);
+                if(it == firstHit.end() || times[k] < it->second) firstHit[e] = times[k];
             }
         }
+        auto first = [&](size_t k) {
+            for(entity e : { collisions[k].first, collisions[k].second }) {
+                auto it = firstHit.find(e);
+                if(it != firstHit.end() && times[k] > it->second) return false;
+            }
+            return true;
+        };
         // handle pairwise collisions (should be eventually moved to a proper system)
-        for(auto [e1, e2] : collisions) {
-            bool moving1 = c.hasComponents<velocity>(e1);
-            bool moving2 = c.hasComponents<velocity>(e2);
+        std::vector<std::pair<entity,entity>> now;
+        // fast movers stopped short this tick: the part of their move past the contact point
+        std::map<entity,vec2f> clips;
+        for(size_t k = 0; k < collisions.size(); ++k) {
+            if(!first(k)) continue;
+            auto [e1, e2] = collisions[k];
+            now.emplace_back(std::min(e1,e2), std::max(e1,e2));
+            // contact wakes sleeping bodies
+            sleeper.wake(c, e1);
+            sleeper.wake(c, e2);
             bool dragging1 = c.hasComponents<friction>(e1);
             bool dragging2 = c.hasComponents<friction>(e2);
             bool massy1 = c.hasComponents<mass>(e1);
@@ -434,68 +611,200 @@ namespace systems {
             }
             // stop whichever one (or both) if they are moving)
             // TODO: this leads to moving entities getting stuck together
+            //     (a fast mover keeps its velocity, its move this tick ends at the contact point)
             else {
-                if(moving1) {
-                    c.getComponent<velocity>(e1)->x = 0;
-                    c.getComponent<velocity>(e1)->y = 0;
-                }
-                if(moving2) {
-                    c.getComponent<velocity>(e2)->x = 0;
-                    c.getComponent<velocity>(e2)->y = 0;
+                for(entity e : { e1, e2 }) {
+                    auto v = c.getComponent<velocity>(e);
+                    if(v == nullptr) continue;
+                    if(c.hasComponents<fast>(e)) {
+                        float cut = (1.f - times[k]) * dt;
+                        clips.emplace(e, vec2f(cut * v->x, cut * v->y));
+                    }
+                    else {
+                        v->x = 0.f;
+                        v->y = 0.f;
+                    }
                 }
             }
         }
+        // pulled back by the cut, so the move that follows (p += v*dt) ends at the contact point
+        for(auto [e, cut] : clips) {
+            if(auto p = c.getComponent<position>(e)) {
+                p->x -= cut.x;
+                p->y -= cut.y;
+            }
+        }
+        // contact events: diff against the pairs touching last tick
+        std::sort(now.begin(), now.end());
+        now.erase(std::unique(now.begin(), now.end()), now.end());
+        auto& touching = s.touching;
+        auto& contacts = s.contacts;
+        contacts.clear();
+        size_t p = 0, q = 0;
+        while(p < touching.size() || q < now.size()) {
+            if(q == now.size() || (p < touching.size() && touching[p] < now[q])) {
+                contacts.push_back(contact{ touching[p].first, touching[p].second, contact::phase::end });
+                ++p;
+            }
+            else if(p == touching.size() || now[q] < touching[p]) {
+                contacts.push_back(contact{ now[q].first, now[q].second, contact::phase::begin });
+                ++q;
+            }
+            else {
+                contacts.push_back(contact{ now[q].first, now[q].second, contact::phase::stay });
+                ++p; ++q;
+            }
+        }
+        touching.swap(now);
+    }
+    const std::vector<contact>& Collision::contacts(Context& c) {
+        static const std::vector<contact> none;
+        const State* s = c.findState<State>();
+        return (s != nullptr) ? s->contacts : none;
     }
     // Combat
-    void CombatAI::update(Context& c) {
-        for(entity e : c.getEntities()) {
-            // enemies - attack entities that have a combat component
-            if(c.hasComponents<position,velocity,enemy>(e)) {
-                auto x = c.getComponent<position>(e)->x;
-                auto y = c.getComponent<position>(e)->y;
-                // if passive, roam about
-                if(targets.count(e) == 0) {
-                    for(entity t : c.getEntities()) {
-                        if(e == t) continue;
-                        if(c.hasComponents<position,velocity,combat>(t)) {
-                            auto x2 = c.getComponent<position>(t)->x;
-                            auto y2 = c.getComponent<position>(t)->y;
-                            float dx = x2-x, dy = y2-y;
-                            float dr = sqrt(dx*dx+dy*dy);
-                            // set target to combatant
-                            if(dr < 16.0f*5.0f) {
-                                targets[e] = t;
-                                glog.get() << "[systems::CombatAI]: registering target!\n";
-                            }
-                            // play doom music
-                        }
-                    }
+    //     world centre of an entity's box (its position if it has no volume)
+    static vec2f centerOf(Context& c, entity e) {
+        vec2f p(c.getComponent<position>(e)->x, c.getComponent<position>(e)->y);
+        if(auto v = c.getComponent<volume>(e)) {
+            p.x += v->box.x + v->box.w/2.f;
+            p.y += v->box.y + v->box.h/2.f;
+        }
+        return p;
+    }
+    void CombatAI::update(Context& c, float dt) {
+        State& s = c.state<State>();
+        auto& targets = s.targets;
+        auto& fields = s.fields;
+        auto& agents = s.agents;
+        uint64_t& tick = s.tick;
+        ++tick;
+        // forget enemies that have despawned
+        for(auto it = targets.begin(); it != targets.end();) {
+            if(!c.alive(it->first)) it = targets.erase(it);
+            else ++it;
+        }
+        for(auto it = agents.begin(); it != agents.end();) {
+            if(!c.alive(it->first)) it = agents.erase(it);
+            else ++it;
+        }
+        // enemies run into by a combatant target it
+        for(const contact& ct : Collision::contacts(c)) {
+            if(ct.state != contact::phase::begin) continue;
+            for(auto [e, t] : { std::make_pair(ct.a, ct.b), std::make_pair(ct.b, ct.a) }) {
+                if(c.hasComponents<position,velocity,enemy>(e) && c.hasComponents<position,velocity,combat>(t)
+                    && targets.count(e) == 0) {
+                    targets[e] = t;
+                    glog.get() << "[systems::CombatAI]: registering target on contact!\n";
+                }
+            }
+        }
+        // flow fields toward every chased target, over the static collision grid
+        //     (rebuilt only when a target moves into another cell)
+        const TileGrid* grid = nullptr;
+        c.view<terrain>().each([&grid](entity, terrain& ter) {
+            grid = ter.grid.get();
+        });
+        std::map<entity,FlowField> chased;
+        if(grid != nullptr) {
+            for(auto [e, t] : targets) {
+                if(!c.alive(t) || !c.hasComponents<position>(t) || chased.count(t) != 0) continue;
+                auto it = fields.find(t);
+                FlowField& field = chased[t];
+                if(it != fields.end()) field = std::move(it->second);
+                field.build(*grid, centerOf(c, t));
+            }
+        }
+        fields.swap(chased);
+        // level of detail: think less often further from the camera target
+        bool focused = false;
+        vec2f focus(0.f,0.f);
+        c.view<camera>().each([&](entity, camera& cam) {
+            if(c.alive(cam.target) && c.hasComponents<position>(cam.target)) {
+                focus = centerOf(c, cam.target);
+                focused = true;
+            }
+        });
+        auto periodAt = [&](vec2f p) {
+            if(!focused) return 1u;
+            float d = std::sqrt((p.x-focus.x)*(p.x-focus.x) + (p.y-focus.y)*(p.y-focus.y));
+            unsigned period = 1;
+            for(float r = nearDistance; d > r && period < maxPeriod; r *= 2.f) period *= 2;
+            return period;
+        };
+        // due enemies, most overdue first
+        std::vector<std::pair<uint64_t,entity>> due;
+        c.view<position,velocity,enemy>().each([&](entity e, position&, velocity&, enemy&) {
+            auto it = agents.find(e);
+            if(it == agents.end()) it = agents.emplace(e, agent{ 1, tick - 1, tick }).first;
+            if(it->second.due <= tick) due.emplace_back(it->second.due, e);
+        });
+        std::sort(due.begin(), due.end());
+        // think within the budget (at least one enemy per tick, so nobody starves)
+        auto begin = std::chrono::steady_clock::now();
+        thought = 0;
+        for(auto [when, e] : due) {
+            float used = std::chrono::duration<float,std::micro>(std::chrono::steady_clock::now() - begin).count();
+            if(thought > 0 && used >= budget) break;
+            agent& a = agents[e];
+            think(c, s, e, float(tick - a.last) * dt);
+            a.period = periodAt(centerOf(c, e));
+            a.last = tick;
+            a.due = tick + a.period;
+            ++thought;
+        }
+        deferred = due.size() - thought;
+        spent = std::chrono::duration<float,std::micro>(std::chrono::steady_clock::now() - begin).count();
+        glog.get() << "[systems::CombatAI]: " << thought << " enemies thought in " << spent << " us, "
+                   << deferred << " deferred\n";
+    }
+    void CombatAI::think(Context& c, State& s, entity e, float dt) {
+        auto& targets = s.targets;
+        auto& fields = s.fields;
+        vec2f vE = centerOf(c, e);
+        // if passive, roam about
+        if(targets.count(e) == 0) {
+            // set target to the nearest combatant in range
+            auto x = c.getComponent<position>(e)->x;
+            auto y = c.getComponent<position>(e)->y;
+            auto near = c.nearest<position,velocity,combat>(vec2f(x,y), 1, aggroRadius, e);
+            if(!near.empty()) {
+                targets[e] = near.front();
+                glog.get() << "[systems::CombatAI]: registering target!\n";
+                // play doom music
+            }
+        }
+        else if(!c.alive(targets[e])) {
+            // target despawned: go back to roaming
+            targets.erase(e);
+        }
+        else {
+            // steer towards target: along its flow field, straight at it once
+            // in the same cell (or with no way around)
+            entity t = targets[e];
+            const float maxSpeed = 30.0f;
+            vec2f dir(0.f,0.f);
+            auto field = fields.find(t);
+            if(field != fields.end()) dir = field->second.direction(vE);
+            if(dir.x == 0.f && dir.y == 0.f) {
+                vec2f vTE = centerOf(c, t)-vE;
+                float len = sqrtf(vTE.x*vTE.x + vTE.y*vTE.y);
+                if(len > 0.f) dir = vTE / len;
+            }
+            if(c.hasComponents<velocity,acceleration>(e)) {
+                float& u = c.getComponent<velocity>(e)->x;
+                float& v = c.getComponent<velocity>(e)->y;
+                float speed = sqrtf(u*u + v*v);
+                if(speed < maxSpeed) {
+                    glog.get() << "[systems::CombatAI]: swiggity swooty\n";
+                    // steering rate per second (0.3 per tick at 60 Hz)
+                    u += 18.0f * dt * dir.x;
+                    v += 18.0f * dt * dir.y;
                 }
                 else {
-                    // steer towards target
-                    entity t = targets[e];
-                    const float maxSpeed = 30.0f;
-                    // displacement vector
-                    vec2f vE = vec2f(c.getComponent<position>(e)->x,c.getComponent<position>(e)->y);
-                    vec2f vT = vec2f(c.getComponent<position>(t)->x,c.getComponent<position>(t)->y);
-                    vec2f vET = vE-vT;
-                    float len = sqrtf(vET.x*vET.x + vET.y*vET.y);
-                    vec2f nvET = vET / len;
-                    if(c.hasComponents<velocity,acceleration>(e)) {
-                        float& u = c.getComponent<velocity>(e)->x;
-                        float& v = c.getComponent<velocity>(e)->y;
-                        float speed = sqrtf(u*u + v*v);
-                        if(speed < maxSpeed) {
-                            glog.get() << "[systems::CombatAI]: swiggity swooty\n";
-                            c.getComponent<velocity>(e)->x -= 0.3f * nvET.x;
-                            c.getComponent<velocity>(e)->y -= 0.3f * nvET.y;
-                        }
-                        else {
-                            // cap speed
-                            u = maxSpeed * nvET.x;
-                            v = maxSpeed * nvET.y;
-                        }
-                    }
+                    // cap speed
+                    u = maxSpeed * dir.x;
+                    v = maxSpeed * dir.y;
                 }
             }
         }
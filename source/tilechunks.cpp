@@ -0,0 +1,129 @@
+#include "tilechunks.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+TileChunks::TileChunks(std::vector<std::vector<unsigned>> gids, unsigned tileW, unsigned tileH,
+    TileSource source, unsigned chunkSize)
+    : gids(std::move(gids)), tileW(tileW), tileH(tileH), source(std::move(source))
+{
+    mapH = unsigned(this->gids.size())*tileH;
+    mapW = this->gids.empty() ? 0 : unsigned(this->gids[0].size())*tileW;
+    // whole tiles per chunk
+    chunkW = std::max(1u, chunkSize/tileW)*tileW;
+    chunkH = std::max(1u, chunkSize/tileH)*tileH;
+    cols = (mapW + chunkW - 1)/chunkW;
+    rows = (mapH + chunkH - 1)/chunkH;
+    chunks.resize(size_t(cols)*rows);
+}
+SDL_Rect TileChunks::bounds(size_t k) const {
+    unsigned x = unsigned(k % cols)*chunkW, y = unsigned(k / cols)*chunkH;
+    return { int(x), int(y), int(std::min(chunkW, mapW - x)), int(std::min(chunkH, mapH - y)) };
+}
+void TileChunks::range(const rectf& r, int& c0, int& c1, int& r0, int& r1) const {
+    c0 = std::max(0, int(std::floor(r.x/chunkW)));
+    r0 = std::max(0, int(std::floor(r.y/chunkH)));
+    c1 = std::min(int(cols) - 1, int(std::floor((r.x + r.w)/chunkW)));
+    r1 = std::min(int(rows) - 1, int(std::floor((r.y + r.h)/chunkH)));
+}
+void TileChunks::stream(SDL_Renderer& r, const rectf& view, float margin, size_t budget) {
+    ++frame;
+    visible.clear();
+    int c0, c1, r0, r1;
+    range(view, c0, c1, r0, r1);
+    for(int i = r0; i <= r1; ++i) {
+        for(int j = c0; j <= c1; ++j) {
+            size_t k = size_t(i)*cols + j;
+            if(chunks[k].tex == nullptr) render(r, k);
+            chunks[k].used = frame;
+            chunks[k].drawn = frame;
+            visible.push_back(k);
+        }
+    }
+    // near the view: keep what is there, render a few more ahead of time
+    rectf near(view.x - margin, view.y - margin, view.w + 2.f*margin, view.h + 2.f*margin);
+    range(near, c0, c1, r0, r1);
+    unsigned fetched = 0;
+    for(int i = r0; i <= r1; ++i) {
+        for(int j = c0; j <= c1; ++j) {
+            size_t k = size_t(i)*cols + j;
+            if(chunks[k].tex == nullptr) {
+                SDL_Rect b = bounds(k);
+                if(fetched == prefetch || bytes + size_t(b.w)*b.h*4 > budget) continue;
+                render(r, k);
+                ++fetched;
+            }
+            chunks[k].used = frame;
+        }
+    }
+    evict(budget);
+}
+void TileChunks::render(SDL_Renderer& r, size_t k) {
+    SDL_Rect b = bounds(k);
+    Chunk& ch = chunks[k];
+    ch.tex = SDL_CreateTexture(&r, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, b.w, b.h);
+    if(ch.tex == nullptr) return;
+    SDL_SetTextureBlendMode(ch.tex, SDL_BLENDMODE_BLEND);
+    // render into the chunk, then restore the renderer's target & draw color
+    SDL_Texture* target = SDL_GetRenderTarget(&r);
+    Uint8 cr, cg, cb, ca;
+    SDL_GetRenderDrawColor(&r, &cr, &cg, &cb, &ca);
+    SDL_SetRenderTarget(&r, ch.tex);
+    SDL_SetRenderDrawColor(&r, 0, 0, 0, 0);
+    SDL_RenderClear(&r);
+    unsigned i1 = std::min(unsigned(gids.size()), (b.y + b.h)/tileH);
+    for(unsigned i = b.y/tileH; i < i1; ++i) {
+        unsigned j1 = std::min(unsigned(gids[i].size()), (b.x + b.w)/tileW);
+        for(unsigned j = b.x/tileW; j < j1; ++j) {
+            unsigned gid = gids[i][j];
+            // Tiled flip bits: horizontal, vertical, diagonal (applied diagonal first)
+            bool flipH = gid & 0x80000000u, flipV = gid & 0x40000000u, flipD = gid & 0x20000000u;
+            gid &= 0x1fffffffu;
+            // empty
+            if(gid == 0) continue;
+            auto [tex, src] = source(gid);
+            SDL_Rect dst = { int(j*tileW) - b.x, int(i*tileH) - b.y, src.w, src.h };
+            // as one copy: the diagonal flip is a 90 degree turn of the vertically
+            // flipped tile, which swaps the roles of the other two flips
+            double angle = 0.0;
+            if(flipD) {
+                angle = 90.0;
+                std::swap(flipH, flipV);
+                flipV = !flipV;
+            }
+            int flip = (flipH ? SDL_FLIP_HORIZONTAL : 0) | (flipV ? SDL_FLIP_VERTICAL : 0);
+            SDL_RenderCopyEx(&r, tex, &src, &dst, angle, nullptr, SDL_RendererFlip(flip));
+        }
+    }
+    SDL_SetRenderTarget(&r, target);
+    SDL_SetRenderDrawColor(&r, cr, cg, cb, ca);
+    bytes += size_t(b.w)*b.h*4;
+    resident.push_back(k);
+}
+void TileChunks::evict(size_t budget) {
+    while(bytes > budget) {
+        // least recently used, not drawn this frame
+        size_t lru = resident.size();
+        for(size_t n = 0; n < resident.size(); ++n) {
+            const Chunk& ch = chunks[resident[n]];
+            if(ch.drawn == frame) continue;
+            if(lru == resident.size() || ch.used < chunks[resident[lru]].used) lru = n;
+        }
+        if(lru == resident.size()) break;
+        size_t k = resident[lru];
+        SDL_Rect b = bounds(k);
+        SDL_DestroyTexture(chunks[k].tex);
+        chunks[k].tex = nullptr;
+        bytes -= size_t(b.w)*b.h*4;
+        resident[lru] = resident.back();
+        resident.pop_back();
+    }
+}
+void TileChunks::release() {
+    for(size_t k : resident) {
+        SDL_DestroyTexture(chunks[k].tex);
+        chunks[k].tex = nullptr;
+    }
+    resident.clear();
+    bytes = 0;
+}
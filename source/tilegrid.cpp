@@ -0,0 +1,50 @@
+#include "tilegrid.hpp"
+
+#include <limits>
+
+TileGrid::TileGrid(unsigned width, unsigned height, float tilewidth, float tileheight)
+    : width(width), height(height), tilewidth(tilewidth), tileheight(tileheight),
+      cellStart(size_t(width)*height + 1, 0) {}
+void TileGrid::add(const rectf& box) {
+    boxes.push_back(box);
+}
+// bucket the added boxes by cell (counting pass, then fill)
+void TileGrid::build() {
+    std::fill(cellStart.begin(), cellStart.end(), 0);
+    int x0, y0, x1, y1;
+    for(const rectf& r : boxes) {
+        if(!cells(r, x0, y0, x1, y1)) continue;
+        for(int y = y0; y <= y1; ++y) {
+            for(int x = x0; x <= x1; ++x) {
+                ++cellStart[size_t(y)*width + x + 1];
+            }
+        }
+    }
+    for(size_t k = 1; k < cellStart.size(); ++k) {
+        cellStart[k] += cellStart[k-1];
+    }
+    cellBoxes.assign(cellStart.back(), 0);
+    std::vector<uint32_t> fill(cellStart.begin(), cellStart.end() - 1);
+    for(uint32_t i = 0; i < boxes.size(); ++i) {
+        if(!cells(boxes[i], x0, y0, x1, y1)) continue;
+        for(int y = y0; y <= y1; ++y) {
+            for(int x = x0; x <= x1; ++x) {
+                cellBoxes[fill[size_t(y)*width + x]++] = i;
+            }
+        }
+    }
+}
+bool TileGrid::collides(const rectf& r) const {
+    bool hit = false;
+    query(r, [&](const rectf& box) {
+        hit = hit || collision(r, box);
+    });
+    return hit;
+}
+float TileGrid::timeOfImpact(const rectf& r, vec2f d) const {
+    float t = std::numeric_limits<float>::infinity();
+    query(swept(r, d), [&](const rectf& box) {
+        t = std::min(t, ::timeOfImpact(r, d, box, vec2f(0.f,0.f)));
+    });
+    return t;
+}
@@ -0,0 +1,39 @@
+// split integrator: the SIMD paths must match the scalar references
+#include "integrate.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+int main() {
+    std::mt19937 rng(2021);
+    std::uniform_real_distribution<float> value(-100.f, 100.f), weight(0.1f, 10.f);
+    int failures = 0;
+    // sizes around the SSE (4) and AVX2 (8) widths, to cover the remainders
+    for(size_t n : {0, 1, 3, 4, 5, 7, 8, 9, 15, 16, 17, 100, 1023}) {
+        std::vector<float> p(2*n), v(2*n), a(2*n), f(2*n), m(n);
+        for(size_t k = 0; k < 2*n; ++k) {
+            p[k] = value(rng); v[k] = value(rng); a[k] = value(rng); f[k] = value(rng);
+        }
+        for(float& w : m) w = weight(rng);
+        std::vector<float> p2 = p, v2 = v, a2 = a;
+        // a few steps, so differences would compound
+        for(int step = 0; step < 10; ++step) {
+            accelerateScalar(n, v.data(), a.data(), f.data(), m.data(), 1.f/60.f);
+            advanceScalar(n, p.data(), v.data(), 1.f/60.f);
+            accelerate(n, v2.data(), a2.data(), f.data(), m.data(), 1.f/60.f);
+            advance(n, p2.data(), v2.data(), 1.f/60.f);
+        }
+        for(size_t k = 0; k < 2*n; ++k) {
+            if(p[k] != p2[k] || v[k] != v2[k] || a[k] != a2[k]) {
+                std::printf("n = %zu, float %zu: scalar (%g,%g,%g) != simd (%g,%g,%g)\n",
+                    n, k, p[k], v[k], a[k], p2[k], v2[k], a2[k]);
+                ++failures;
+                break;
+            }
+        }
+    }
+    std::printf("integrate: %s\n", failures == 0 ? "ok" : "FAILED");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,99 @@
+// physics tick order: a body pushed into a wall by a force must stop at it,
+// for a slow body against another body's box, and a fast one against terrain;
+// a fast mover stopped by a wall keeps its velocity (only that tick's move is cut)
+#include "systems.hpp"
+#include "jobs.hpp"
+#include "logger.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <memory>
+
+Logger glog("test-physics.log");
+ThreadPool jobs;
+
+static int failures = 0;
+static void expect(bool ok, const char* what) {
+    if(!ok) {
+        std::printf("%s\n", what);
+        ++failures;
+    }
+}
+// one simulation tick, in the order main runs the physics systems
+static void tick(Context& c, systems::Integrator& integrator, float dt) {
+    integrator.accelerate(c, dt);
+    systems::collider.update(c);
+    systems::collider.resolve(c, dt);
+    integrator.move(c, dt);
+    systems::commands(c).apply(c);
+}
+static std::shared_ptr<TileGrid> wall() {
+    auto grid = std::make_shared<TileGrid>(8, 8, 16.f, 16.f);
+    grid->add(rectf(32.f, -16.f, 8.f, 40.f));
+    grid->build();
+    return grid;
+}
+static entity body(Context& c, float x, float fx) {
+    entity e = c.addEntity();
+    c.addComponent<position>(e, x, 0.f);
+    c.addComponent<velocity>(e, 0.f, 0.f);
+    c.addComponent<acceleration>(e, 0.f, 0.f);
+    c.addComponent<force>(e, fx, 0.f);
+    c.addComponent<mass>(e, 1.f);
+    c.addComponent<volume>(e, rectf(0.f, 0.f, 8.f, 8.f));
+    return e;
+}
+
+int main(int, char*[]) {
+    const float dt = 1.f/60.f;
+    // contact points are found in floating point
+    const float slack = 1e-3f;
+    systems::Integrator integrator;
+    // slow body, pushed against a static box at x = 32
+    {
+        Context c;
+        entity e = body(c, 0.f, 600.f);
+        entity wall = c.addEntity();
+        c.addComponent<position>(wall, 32.f, -16.f);
+        c.addComponent<volume>(wall, rectf(0.f, 0.f, 8.f, 40.f));
+        bool through = false;
+        for(int t = 0; t < 120; ++t) {
+            tick(c, integrator, dt);
+            through = through || c.getComponent<position>(e)->x + 8.f > 32.f + slack;
+        }
+        expect(!through, "pushed body entered the wall");
+        expect(c.getComponent<position>(e)->x > 16.f, "pushed body did not move");
+    }
+    // fast body, accelerated past the wall's width in one tick, against terrain at x = 32
+    {
+        Context c;
+        entity e = body(c, 0.f, 200000.f);
+        c.addComponent<fast>(e);
+        entity ground = c.addEntity();
+        c.addComponent<terrain>(ground, wall());
+        bool through = false;
+        for(int t = 0; t < 30; ++t) {
+            tick(c, integrator, dt);
+            through = through || c.getComponent<position>(e)->x + 8.f > 32.f + slack;
+        }
+        expect(!through, "fast body tunnelled through terrain");
+    }
+    // fast body at constant speed into terrain, then turned around
+    {
+        Context c;
+        entity e = body(c, 0.f, 0.f);
+        c.addComponent<fast>(e);
+        c.getComponent<velocity>(e)->x = 3000.f;
+        entity ground = c.addEntity();
+        c.addComponent<terrain>(ground, wall());
+        tick(c, integrator, dt);
+        expect(c.getComponent<position>(e)->x + 8.f <= 32.f + slack, "fast body tunnelled through terrain");
+        expect(c.getComponent<velocity>(e)->x == 3000.f, "fast body slowed down by the hit");
+        float x = c.getComponent<position>(e)->x;
+        c.getComponent<velocity>(e)->x = -3000.f;
+        tick(c, integrator, dt);
+        expect(std::fabs(c.getComponent<position>(e)->x - (x - 3000.f*dt)) < slack, "fast body not moving at full speed after the hit");
+    }
+    std::printf("physics: %s\n", failures == 0 ? "ok" : "FAILED");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,64 @@
+// spatial queries: a removed entity's box must not be returned, not even once
+// its index is reused, until the next pass indexes the new entity
+#include "context.hpp"
+
+#include <cstdio>
+#include <vector>
+
+static int failures = 0;
+static void expect(bool ok, const char* what) {
+    if(!ok) {
+        std::printf("%s\n", what);
+        ++failures;
+    }
+}
+// one collision pass: the boxes of es, as the collision system would insert them
+static void pass(Context& c, const std::vector<std::pair<entity,rectf>>& es) {
+    std::vector<std::pair<uint32_t,uint32_t>> pairs;
+    c.beginIndex();
+    for(auto& [e, r] : es) c.index(e, r, false);
+    c.endIndex(pairs);
+}
+
+int main() {
+    Context c;
+    entity a = c.addEntity(), b = c.addEntity();
+    rectf ra(0.f, 0.f, 10.f, 10.f), rb(100.f, 0.f, 10.f, 10.f);
+    pass(c, { { a, ra }, { b, rb } });
+    expect(c.queryBox(ra).size() == 1 && c.queryBox(ra)[0] == a, "indexed entity not found");
+    // removed: its box is still in the index until the next pass
+    c.removeEntity(a);
+    expect(c.queryBox(ra).empty(), "removed entity returned by queryBox");
+    expect(c.queryCircle(vec2f(5.f, 5.f), 1.f).empty(), "removed entity returned by queryCircle");
+    expect(c.nearest<>(vec2f(5.f, 5.f), 1, 50.f).empty(), "removed entity returned by nearest");
+    expect(c.raycast<>(vec2f(-5.f, 5.f), vec2f(50.f, 5.f)).first == nullEntity, "removed entity hit by raycast");
+    // respawned at the same index: the old box is not the new entity's
+    entity n = c.addEntity();
+    expect(entityIndex(n) == entityIndex(a), "index not reused");
+    expect(c.queryBox(ra).empty(), "respawned entity returned at the removed entity's box");
+    expect(c.queryBox(rb).size() == 1 && c.queryBox(rb)[0] == b, "other entity lost");
+    // next pass: the new entity at its own box
+    rectf rn(50.f, 50.f, 10.f, 10.f);
+    pass(c, { { b, rb }, { n, rn } });
+    expect(c.queryBox(ra).empty(), "stale box after the next pass");
+    expect(c.queryBox(rn).size() == 1 && c.queryBox(rn)[0] == n, "respawned entity not found");
+    // unindexed: spawned since the last pass, or left out of it, until it is boxed again
+    auto unindexed = [&](entity e) {
+        bool found = false;
+        c.eachUnindexed([&](entity u) { found = found || u == e; });
+        return found;
+    };
+    entity s = c.addEntity();
+    expect(unindexed(s), "spawned entity not unindexed before the next pass");
+    expect(!unindexed(b) && !unindexed(n), "indexed entity listed as unindexed");
+    pass(c, { { n, rn } });
+    expect(unindexed(s) && unindexed(b), "entity without a box not unindexed");
+    pass(c, { { b, rb }, { n, rn }, { s, ra } });
+    expect(!unindexed(s) && !unindexed(b), "boxed entity still unindexed");
+    c.removeEntity(s);
+    pass(c, { { b, rb } });
+    expect(!unindexed(s), "removed entity listed as unindexed");
+    expect(unindexed(n), "entity dropped from the index not unindexed");
+    std::printf("spatial: %s\n", failures == 0 ? "ok" : "FAILED");
+    return failures == 0 ? 0 : 1;
+}